@@ -0,0 +1,679 @@
+/*
+ * GStreamer
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * gzdec-bench
+ *
+ * Decodes a corpus through gzdec with several input buffer sizes and
+ * prints one JSON object per run on stdout:
+ *
+ *   {"corpus": "text", "mode": "harness", "buffer-size": 65536, ...}
+ *
+ * with the throughput in decoded MB/s, the output chunks gzdec allocated
+ * per decoded MB (the "chunks" member of its stats property) and, in
+ * harness mode, the median and 99th percentile of the time one chain
+ * call takes. Harness mode pushes on the calling thread through
+ * GstHarness, pipeline mode runs appsrc ! gzdec ! appsink.
+ *
+ * Without arguments a synthetic corpus is generated: text logs, binary
+ * media like samples and incompressible data as single gzip members,
+ * text as independently compressed 1 MiB gzip members (pigz -i, or
+ * concatenated .gz files) and as concatenated bzip2 streams (pbzip2).
+ * Files given on the command line are benchmarked as they are instead.
+ *
+ * The decoded size and CRC-32 of every run of a generated corpus are
+ * checked against the data it was generated from; a mismatch fails the
+ * run and the exit status. Checksumming is not counted as decoding time.
+ *
+ *   gzdec-bench --buffer-sizes=4096,1048576 --set threads=4 logs.gz
+ */
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <gst/check/gstharness.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include <math.h>
+#include <string.h>
+
+#define DEFAULT_CORPUS_SIZE  16
+#define DEFAULT_ITERATIONS   3
+#define DEFAULT_BUFFER_SIZES "4096,65536,1048576"
+// Piece size of the multi member corpora, pbzip2 uses 900 kB blocks
+#define MEMBER_SIZE          (1024 * 1024)
+#define BZIP2_STREAM_SIZE    (900 * 1000)
+// Bound on the input queued in appsrc in pipeline mode
+#define APPSRC_MAX_BYTES     (4 * 1024 * 1024)
+#define PULL_TIMEOUT         (100 * GST_MSECOND)
+
+typedef struct
+{
+  gchar  * name;
+  gchar  * caps;
+  GBytes * data;
+  // Decoded size and CRC-32 a run must produce, if known
+  gboolean checked;
+  guint64  decoded_size;
+  guint32  decoded_crc;
+} Corpus;
+
+typedef struct
+{
+  guint64  bytes_in;
+  guint64  bytes_out;
+  guint64  chunks;
+  gint64   elapsed;
+  // Microseconds per chain call, harness mode only
+  GArray * latencies;
+  // Output of the current run
+  guint64  run_bytes;
+  guint32  run_crc;
+} Result;
+
+static gint corpus_size = DEFAULT_CORPUS_SIZE;
+static gint iterations = DEFAULT_ITERATIONS;
+static gchar *buffer_sizes = NULL;
+static gboolean pipeline_mode = FALSE;
+static gchar **properties = NULL;
+static gchar **files = NULL;
+
+static GOptionEntry entries[] = {
+  {"size", 's', 0, G_OPTION_ARG_INT, &corpus_size,
+      "Decoded size of each generated corpus in MiB", "MIB"},
+  {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+      "Times each corpus is decoded per buffer size", "N"},
+  {"buffer-sizes", 'b', 0, G_OPTION_ARG_STRING, &buffer_sizes,
+      "Comma separated input buffer sizes (default " DEFAULT_BUFFER_SIZES
+        ")", "SIZES"},
+  {"pipeline", 'p', 0, G_OPTION_ARG_NONE, &pipeline_mode,
+      "Run appsrc ! gzdec ! appsink instead of GstHarness", NULL},
+  {"set", 0, 0, G_OPTION_ARG_STRING_ARRAY, &properties,
+      "Set a gzdec property, may be repeated", "NAME=VALUE"},
+  {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files,
+      NULL, "[FILE...]"},
+  {NULL}
+};
+
+static void
+corpus_free (Corpus * corpus)
+{
+  g_free (corpus->name);
+  g_free (corpus->caps);
+  g_bytes_unref (corpus->data);
+  g_free (corpus);
+}
+
+static Corpus *
+corpus_new (const gchar * name, const gchar * caps, GByteArray * data)
+{
+  Corpus *corpus = g_new0 (Corpus, 1);
+
+  corpus->name = g_strdup (name);
+  corpus->caps = g_strdup (caps);
+  corpus->data = g_byte_array_free_to_bytes (data);
+
+  return corpus;
+}
+
+static void
+corpus_set_decoded (Corpus * corpus, const guint8 * data, gsize size)
+{
+  corpus->checked = TRUE;
+  corpus->decoded_size = size;
+  corpus->decoded_crc = crc32 (crc32 (0, NULL, 0), data, size);
+}
+
+static void
+gzip_append (GByteArray * out, const guint8 * data, gsize size)
+{
+  z_stream strm = { 0 };
+  guint pos = out->len;
+
+  deflateInit2 (&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+      Z_DEFAULT_STRATEGY);
+  g_byte_array_set_size (out, pos + deflateBound (&strm, size));
+  strm.next_in = (guint8 *) data;
+  strm.avail_in = size;
+  strm.next_out = out->data + pos;
+  strm.avail_out = out->len - pos;
+  if (deflate (&strm, Z_FINISH) != Z_STREAM_END)
+    g_error ("deflate failed");
+  g_byte_array_set_size (out, pos + strm.total_out);
+  deflateEnd (&strm);
+}
+
+static void
+bzip2_append (GByteArray * out, const guint8 * data, gsize size)
+{
+  guint pos = out->len;
+  // Worst case from the libbz2 manual
+  guint len = size + size / 100 + 600;
+
+  g_byte_array_set_size (out, pos + len);
+  if (BZ2_bzBuffToBuffCompress ((gchar *) out->data + pos, &len,
+          (gchar *) data, size, 9, 0, 0) != BZ_OK)
+    g_error ("BZ2_bzBuffToBuffCompress failed");
+  g_byte_array_set_size (out, pos + len);
+}
+
+static GByteArray *
+generate_text (GRand * rand, gsize size)
+{
+  static const gchar *levels[] = { "debug", "info", "info", "warn", "error" };
+  GString *text = g_string_sized_new (size + 256);
+
+  while (text->len < size) {
+    g_string_append_printf (text,
+        "2023-%02u-%02uT%02u:%02u:%02u.%03uZ host-%02u api[%u]: level=%s "
+        "request_id=%08x path=/v1/items/%u status=%u duration_ms=%u\n",
+        g_rand_int_range (rand, 1, 13), g_rand_int_range (rand, 1, 29),
+        g_rand_int_range (rand, 0, 24), g_rand_int_range (rand, 0, 60),
+        g_rand_int_range (rand, 0, 60), g_rand_int_range (rand, 0, 1000),
+        g_rand_int_range (rand, 0, 16), g_rand_int_range (rand, 1000, 1016),
+        levels[g_rand_int_range (rand, 0, G_N_ELEMENTS (levels))],
+        g_rand_int (rand), g_rand_int_range (rand, 0, 100000),
+        g_rand_boolean (rand) ? 200 : 404, g_rand_int_range (rand, 0, 500));
+  }
+  g_string_truncate (text, size);
+
+  return g_bytes_unref_to_array (g_string_free_to_bytes (text));
+}
+
+// Noisy slowly changing 16 bit samples, compressing about as badly as
+// uncompressed audio or raw video does
+static GByteArray *
+generate_media (GRand * rand, gsize size)
+{
+  GByteArray *data = g_byte_array_sized_new (size);
+  gsize i;
+
+  g_byte_array_set_size (data, size);
+  for (i = 0; i + 1 < size; i += 2) {
+    gint16 sample = 12000 * sin (i / 300.0) + g_rand_int_range (rand, -64, 64);
+
+    data->data[i] = sample & 0xff;
+    data->data[i + 1] = sample >> 8;
+  }
+
+  return data;
+}
+
+static GByteArray *
+generate_random (GRand * rand, gsize size)
+{
+  GByteArray *data = g_byte_array_sized_new (size);
+  gsize i;
+
+  g_byte_array_set_size (data, size);
+  for (i = 0; i < size; i++)
+    data->data[i] = g_rand_int (rand);
+
+  return data;
+}
+
+static GPtrArray *
+generate_corpus (void)
+{
+  GPtrArray *corpus = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) corpus_free);
+  // Fixed seed so runs are comparable
+  GRand *rand = g_rand_new_with_seed (0x677a6465);
+  gsize size = (gsize) corpus_size * 1024 * 1024;
+  GByteArray *text = generate_text (rand, size);
+  GByteArray *media = generate_media (rand, size);
+  GByteArray *random = generate_random (rand, size);
+  GByteArray *out;
+  gsize pos;
+
+  out = g_byte_array_new ();
+  gzip_append (out, text->data, text->len);
+  g_ptr_array_add (corpus, corpus_new ("text", "application/x-gzip", out));
+  corpus_set_decoded (g_ptr_array_index (corpus, corpus->len - 1),
+      text->data, text->len);
+
+  out = g_byte_array_new ();
+  gzip_append (out, media->data, media->len);
+  g_ptr_array_add (corpus, corpus_new ("media", "application/x-gzip", out));
+  corpus_set_decoded (g_ptr_array_index (corpus, corpus->len - 1),
+      media->data, media->len);
+
+  out = g_byte_array_new ();
+  gzip_append (out, random->data, random->len);
+  g_ptr_array_add (corpus, corpus_new ("random", "application/x-gzip", out));
+  corpus_set_decoded (g_ptr_array_index (corpus, corpus->len - 1),
+      random->data, random->len);
+
+  out = g_byte_array_new ();
+  for (pos = 0; pos < text->len; pos += MEMBER_SIZE)
+    gzip_append (out, text->data + pos, MIN (MEMBER_SIZE, text->len - pos));
+  g_ptr_array_add (corpus, corpus_new ("multi-member", "application/x-gzip",
+          out));
+  corpus_set_decoded (g_ptr_array_index (corpus, corpus->len - 1),
+      text->data, text->len);
+
+  out = g_byte_array_new ();
+  for (pos = 0; pos < text->len; pos += BZIP2_STREAM_SIZE)
+    bzip2_append (out, text->data + pos,
+        MIN (BZIP2_STREAM_SIZE, text->len - pos));
+  g_ptr_array_add (corpus, corpus_new ("pbzip2", "application/x-bzip2",
+          out));
+  corpus_set_decoded (g_ptr_array_index (corpus, corpus->len - 1),
+      text->data, text->len);
+
+  g_byte_array_unref (text);
+  g_byte_array_unref (media);
+  g_byte_array_unref (random);
+  g_rand_free (rand);
+
+  return corpus;
+}
+
+static const gchar *
+caps_for_file (const gchar * path)
+{
+  if (g_str_has_suffix (path, ".bz2") || g_str_has_suffix (path, ".tbz2"))
+    return "application/x-bzip2";
+  if (g_str_has_suffix (path, ".zst"))
+    return "application/zstd";
+  if (g_str_has_suffix (path, ".lz4"))
+    return "application/x-lz4";
+  return "application/x-gzip";
+}
+
+static GPtrArray *
+load_corpus (gchar ** paths)
+{
+  GPtrArray *corpus = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) corpus_free);
+
+  for (; *paths; paths++) {
+    GError *err = NULL;
+    gchar *contents, *name;
+    gsize len;
+
+    if (!g_file_get_contents (*paths, &contents, &len, &err)) {
+      g_printerr ("%s\n", err->message);
+      g_clear_error (&err);
+      continue;
+    }
+
+    name = g_path_get_basename (*paths);
+    g_ptr_array_add (corpus, corpus_new (name, caps_for_file (*paths),
+            g_bytes_unref_to_array (g_bytes_new_take (contents, len))));
+    g_free (name);
+  }
+
+  return corpus;
+}
+
+static void
+configure_gzdec (GstElement * gzdec)
+{
+  gchar **prop;
+
+  for (prop = properties; prop && *prop; prop++) {
+    gchar **kv = g_strsplit (*prop, "=", 2);
+
+    if (kv[0] && kv[1] && g_object_class_find_property (
+            G_OBJECT_GET_CLASS (gzdec), kv[0]))
+      gst_util_set_object_arg (G_OBJECT (gzdec), kv[0], kv[1]);
+    else
+      g_printerr ("Ignoring %s\n", *prop);
+    g_strfreev (kv);
+  }
+}
+
+static guint64
+get_chunks (GstElement * gzdec)
+{
+  GstStructure *stats = NULL;
+  guint64 chunks = 0;
+
+  g_object_get (gzdec, "stats", &stats, NULL);
+  if (stats) {
+    gst_structure_get_uint64 (stats, "chunks", &chunks);
+    gst_structure_free (stats);
+  }
+
+  return chunks;
+}
+
+// Input buffers share the corpus memory, nothing is copied
+static GstBuffer *
+wrap_slice (GBytes * data, gsize offset, gsize size)
+{
+  GBytes *slice = g_bytes_new_from_bytes (data, offset, size);
+  GstBuffer *buf = gst_buffer_new_wrapped_bytes (slice);
+
+  g_bytes_unref (slice);
+
+  return buf;
+}
+
+static void
+run_start (Result * result)
+{
+  result->run_bytes = 0;
+  result->run_crc = crc32 (0, NULL, 0);
+}
+
+/* Count and checksum one output buffer of the current run. Returns the
+ * microseconds taken, which the caller leaves out of the elapsed time.
+ */
+static gint64
+run_output (Result * result, GstBuffer * buf)
+{
+  gint64 start = g_get_monotonic_time ();
+  GstMapInfo map;
+
+  result->bytes_out += gst_buffer_get_size (buf);
+  result->run_bytes += gst_buffer_get_size (buf);
+  if (gst_buffer_map (buf, &map, GST_MAP_READ)) {
+    result->run_crc = crc32 (result->run_crc, map.data, map.size);
+    gst_buffer_unmap (buf, &map);
+  }
+
+  return g_get_monotonic_time () - start;
+}
+
+// Whether the run decoded what the corpus was generated from
+static gboolean
+run_check (const Corpus * corpus, const Result * result)
+{
+  if (!corpus->checked)
+    return TRUE;
+
+  if (result->run_bytes != corpus->decoded_size) {
+    g_printerr ("%s: decoded %" G_GUINT64_FORMAT " bytes, expected %"
+        G_GUINT64_FORMAT "\n", corpus->name, result->run_bytes,
+        corpus->decoded_size);
+    return FALSE;
+  }
+  if (result->run_crc != corpus->decoded_crc) {
+    g_printerr ("%s: decoded CRC-32 %08x, expected %08x\n", corpus->name,
+        result->run_crc, corpus->decoded_crc);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+run_harness (const Corpus * corpus, gsize buffer_size, Result * result)
+{
+  GstHarness *h = gst_harness_new ("gzdec");
+  gsize size = g_bytes_get_size (corpus->data), pos;
+  GstBuffer *buf;
+  gint64 start, checking = 0;
+
+  configure_gzdec (h->element);
+  gst_harness_set_src_caps_str (h, corpus->caps);
+
+  run_start (result);
+  start = g_get_monotonic_time ();
+  for (pos = 0; pos < size; pos += buffer_size) {
+    gsize len = MIN (buffer_size, size - pos);
+    GstFlowReturn ret;
+    gint64 t;
+
+    buf = wrap_slice (corpus->data, pos, len);
+    t = g_get_monotonic_time ();
+    ret = gst_harness_push (h, buf);
+    t = g_get_monotonic_time () - t;
+    g_array_append_val (result->latencies, t);
+    if (ret != GST_FLOW_OK) {
+      g_printerr ("%s: push returned %s\n", corpus->name,
+          gst_flow_get_name (ret));
+      gst_harness_teardown (h);
+      return FALSE;
+    }
+    result->bytes_in += len;
+
+    while ((buf = gst_harness_try_pull (h))) {
+      checking += run_output (result, buf);
+      gst_buffer_unref (buf);
+    }
+  }
+  gst_harness_push_event (h, gst_event_new_eos ());
+  while ((buf = gst_harness_try_pull (h))) {
+    checking += run_output (result, buf);
+    gst_buffer_unref (buf);
+  }
+  result->elapsed += g_get_monotonic_time () - start - checking;
+
+  result->chunks += get_chunks (h->element);
+  gst_harness_teardown (h);
+
+  return run_check (corpus, result);
+}
+
+typedef struct
+{
+  GstAppSrc * src;
+  GBytes    * data;
+  gsize       buffer_size;
+} Feeder;
+
+static gpointer
+feed_appsrc (Feeder * feeder)
+{
+  gsize size, pos;
+
+  g_bytes_get_data (feeder->data, &size);
+  for (pos = 0; pos < size; pos += feeder->buffer_size) {
+    GstBuffer *buf = wrap_slice (feeder->data, pos,
+        MIN (feeder->buffer_size, size - pos));
+
+    if (gst_app_src_push_buffer (feeder->src, buf) != GST_FLOW_OK)
+      return NULL;
+  }
+  gst_app_src_end_of_stream (feeder->src);
+
+  return NULL;
+}
+
+static gboolean
+run_pipeline (const Corpus * corpus, gsize buffer_size, Result * result)
+{
+  GstElement *pipeline, *src, *gzdec, *sink;
+  GstCaps *caps = gst_caps_from_string (corpus->caps);
+  GstSample *sample;
+  GstMessage *msg;
+  GThread *thread;
+  Feeder feeder;
+  gint64 start, checking = 0;
+
+  pipeline = gst_pipeline_new (NULL);
+  src = gst_element_factory_make ("appsrc", NULL);
+  gzdec = gst_element_factory_make ("gzdec", NULL);
+  sink = gst_element_factory_make ("appsink", NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, gzdec, sink, NULL);
+  gst_element_link_many (src, gzdec, sink, NULL);
+
+  g_object_set (src, "caps", caps, "format", GST_FORMAT_BYTES,
+      "block", TRUE, "max-bytes", (guint64) APPSRC_MAX_BYTES, NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_caps_unref (caps);
+  configure_gzdec (gzdec);
+
+  feeder.src = GST_APP_SRC (src);
+  feeder.data = corpus->data;
+  feeder.buffer_size = buffer_size;
+
+  run_start (result);
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  thread = g_thread_new ("feeder", (GThreadFunc) feed_appsrc, &feeder);
+  // appsink only wakes up for samples and EOS, poll the bus for errors
+  msg = NULL;
+  while (!gst_app_sink_is_eos (GST_APP_SINK (sink))) {
+    sample = gst_app_sink_try_pull_sample (GST_APP_SINK (sink),
+        PULL_TIMEOUT);
+    if (sample) {
+      checking += run_output (result, gst_sample_get_buffer (sample));
+      gst_sample_unref (sample);
+    } else if ((msg = gst_bus_pop_filtered (GST_ELEMENT_BUS (pipeline),
+                GST_MESSAGE_ERROR))) {
+      break;
+    }
+  }
+  result->elapsed += g_get_monotonic_time () - start - checking;
+  result->bytes_in += g_bytes_get_size (corpus->data);
+  result->chunks += get_chunks (gzdec);
+
+  if (msg) {
+    GError *err = NULL;
+
+    gst_message_parse_error (msg, &err, NULL);
+    g_printerr ("%s: %s\n", corpus->name, err->message);
+    g_clear_error (&err);
+    gst_message_unref (msg);
+  }
+
+  // Unblocks the feeder if the pipeline stopped early
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_thread_join (thread);
+  gst_object_unref (pipeline);
+
+  return msg == NULL && run_check (corpus, result);
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(const gint64 *) a, lb = *(const gint64 *) b;
+
+  return (la > lb) - (la < lb);
+}
+
+static gint64
+percentile (GArray * latencies, guint p)
+{
+  if (latencies->len == 0)
+    return 0;
+  return g_array_index (latencies, gint64,
+      MIN (latencies->len - 1, (guint64) latencies->len * p / 100));
+}
+
+static void
+print_result (const Corpus * corpus, gsize buffer_size,
+    const Result * result)
+{
+  gdouble mb = result->bytes_out / 1e6;
+
+  g_array_sort (result->latencies, compare_latency);
+  g_print ("{\"corpus\": \"%s\", \"mode\": \"%s\", \"buffer-size\": %"
+      G_GSIZE_FORMAT ", \"iterations\": %d, \"bytes-in\": %" G_GUINT64_FORMAT
+      ", \"bytes-out\": %" G_GUINT64_FORMAT ", \"mb-per-s\": %.2f, "
+      "\"chunks-per-mb\": %.2f", corpus->name,
+      pipeline_mode ? "pipeline" : "harness", buffer_size, iterations,
+      result->bytes_in, result->bytes_out,
+      result->elapsed ? mb / (result->elapsed / 1e6) : 0.0,
+      mb > 0 ? result->chunks / mb : 0.0);
+  if (!pipeline_mode)
+    g_print (", \"chain-p50-us\": %" G_GINT64_FORMAT
+        ", \"chain-p99-us\": %" G_GINT64_FORMAT,
+        percentile (result->latencies, 50), percentile (result->latencies,
+            99));
+  g_print ("}\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GstElementFactory *factory;
+  GPtrArray *corpus;
+  gchar **sizes, **s;
+  gboolean ok = TRUE;
+  guint i;
+
+  ctx = g_option_context_new ("- gzdec benchmark");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  factory = gst_element_factory_find ("gzdec");
+  if (!factory) {
+    g_printerr ("gzdec not found, set GST_PLUGIN_PATH to the build "
+        "directory\n");
+    return 1;
+  }
+  gst_object_unref (factory);
+
+  corpus = files ? load_corpus (files) : generate_corpus ();
+  sizes = g_strsplit (buffer_sizes ? buffer_sizes : DEFAULT_BUFFER_SIZES,
+      ",", -1);
+
+  for (i = 0; i < corpus->len; i++) {
+    const Corpus *c = g_ptr_array_index (corpus, i);
+
+    for (s = sizes; *s; s++) {
+      gsize buffer_size = g_ascii_strtoull (*s, NULL, 10);
+      Result result = { 0 };
+      gint n;
+
+      if (buffer_size == 0)
+        continue;
+
+      result.latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+      for (n = 0; n < iterations && ok; n++)
+        ok = pipeline_mode ? run_pipeline (c, buffer_size, &result) :
+            run_harness (c, buffer_size, &result);
+      if (ok)
+        print_result (c, buffer_size, &result);
+      g_array_unref (result.latencies);
+    }
+  }
+
+  g_strfreev (sizes);
+  g_ptr_array_unref (corpus);
+
+  return ok ? 0 : 1;
+}
@@ -46,8 +46,10 @@
 /**
  * SECTION:element-gzdec
  *
- * gzip bzip2 decoder. Use caps filter for decoding format selection
- * e.g. "application/x-bzip2" ! gzdec will decode bzip streams.
+ * gzip bzip2 decoder. The format is detected from the first bytes of the
+ * stream: gzip, zlib, bzip2, zstd and LZ4 by their magic, raw deflate by
+ * a trial inflate. A caps filter, e.g. "application/x-bzip2" ! gzdec, picks the
+ * format for streams that match none of them.
  *
  * <refsect2>
  * <title>Example launch line</title>
@@ -58,6 +60,7 @@
  */
 
 #include "gst/base/gstbasetransform.h"
+#include "gst/base/gsttypefindhelper.h"
 #include "gst/gstallocator.h"
 #include "gst/gstbuffer.h"
 #include "gst/gstcaps.h"
@@ -79,46 +82,364 @@
 
 #include <gst/gst.h>
 #include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#  include <libdeflate.h>
+#endif
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#  include <zstd_errors.h>
+#endif
+#ifdef HAVE_LZ4
+#  include <lz4frame.h>
+#endif
+#ifdef HAVE_POSIX_MADVISE
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
 #include "gstgzdec.h"
+#include "gstgzdecparallel.h"
+#include "gstgzdecindex.h"
+#include "gstgzdecarena.h"
+#include "gstgzdeccontext.h"
+#include "gstgzdectracer.h"
+#include "gstgzdecring.h"
+#include "gstgzdeccrc.h"
+#include "gstgzdecmeta.h"
+#include "gstgzdecrecords.h"
 
-GST_DEBUG_CATEGORY_STATIC (gst_gzdec_debug);
+GST_DEBUG_CATEGORY (gst_gzdec_debug);
 #define GST_CAT_DEFAULT gst_gzdec_debug
 
+/* Filter properties */
+enum
+{
+  PROP_0,
+  PROP_OUTPUT_CHUNK_SIZE,
+  PROP_ADAPTIVE_CHUNK_SIZE,
+  PROP_CONTIGUOUS_OUTPUT,
+  PROP_USE_BUFFER_POOL,
+  PROP_MAX_OUTPUT_BUFFER_SIZE,
+  PROP_LOW_LATENCY,
+  PROP_THREADS,
+  PROP_BACKEND,
+  PROP_VERIFY,
+  PROP_INDEX_SPAN,
+  PROP_INDEX_LOCATION,
+  PROP_INDEX_WRITE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_TYPEFIND,
+  PROP_ASYNC,
+  PROP_MAX_LEVEL_BYTES,
+  PROP_MIN_INPUT_BYTES,
+  PROP_MAX_INPUT_LATENCY,
+  PROP_MEMBER_META,
+  PROP_FORMAT,
+  PROP_WINDOW_BITS,
+  PROP_DICTIONARY,
+  PROP_RECORDS_PER_BUFFER,
+  PROP_RECORD_META,
+  PROP_WORKER_AFFINITY,
+  PROP_MMAP
+};
+
+#define DEFAULT_OUTPUT_CHUNK_SIZE    OUT_BUF_SIZE
+#define DEFAULT_ADAPTIVE_CHUNK_SIZE  FALSE
+#define DEFAULT_CONTIGUOUS_OUTPUT    FALSE
+#define DEFAULT_USE_BUFFER_POOL      FALSE
+#define DEFAULT_MAX_OUTPUT_BUFFER_SIZE 0
+#define DEFAULT_LOW_LATENCY          FALSE
+#define DEFAULT_THREADS              1
+#define DEFAULT_WORKER_AFFINITY      GST_GZDEC_WORKER_AFFINITY_NONE
+#define DEFAULT_BACKEND              GST_GZDEC_BACKEND_AUTO
+#define DEFAULT_VERIFY               GST_GZDEC_VERIFY_FULL
+#define DEFAULT_INDEX_SPAN           (16 * 1024 * 1024)
+#define DEFAULT_INDEX_LOCATION       NULL
+#define DEFAULT_INDEX_WRITE          FALSE
+#define DEFAULT_STATS_INTERVAL       0
+#define DEFAULT_TYPEFIND             FALSE
+// Decoded bytes held back for typefinding the output
+#define TYPEFIND_SIZE                (16 * 1024)
+// Input held back at the start of a stream to tell its format
+#define DETECT_SIZE                  10
+#define DEFAULT_ASYNC                FALSE
+#define DEFAULT_MAX_LEVEL_BYTES      (2 * 1024 * 1024)
+// Input buffers and events queued in async mode, on top of the byte bound
+#define ASYNC_RING_SLOTS             64
+#define DEFAULT_MIN_INPUT_BYTES      0
+#define DEFAULT_MAX_INPUT_LATENCY    (20 * GST_MSECOND)
+#define DEFAULT_MEMBER_META          FALSE
+#define DEFAULT_FORMAT               GST_GZDEC_INPUT_FORMAT_AUTO
+#define DEFAULT_WINDOW_BITS          15
+#define DEFAULT_RECORDS_PER_BUFFER   0
+#define DEFAULT_RECORD_META          FALSE
+// Output held back for records-per-buffer without max-output-buffer-size
+#define RECORDS_MAX_PENDING          MAX_OUT_BUF_SIZE
+// Range requested from upstream per iteration in pull mode
+#define PULL_BLOCK_SIZE              (1024 * 1024)
+#define DEFAULT_MMAP                 FALSE
+// Mapped input the kernel is asked to read ahead of the decoder
+#define MMAP_READAHEAD               (4 * PULL_BLOCK_SIZE)
+// Expansion ratio assumed before any data has been decoded
+#define DEFAULT_RATIO_ESTIMATE       4
+
+#ifdef HAVE_ZSTD
+#  define ZSTD_CAPS "application/zstd;"
+#else
+#  define ZSTD_CAPS ""
+#endif
+#ifdef HAVE_LZ4
+#  define LZ4_CAPS "application/x-lz4;"
+#else
+#  define LZ4_CAPS ""
+#endif
+
+// application/x-bzip is what the core typefinders call bzip2
 static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS("application/x-gzip;" "application/x-bzip2;")
+    GST_STATIC_CAPS("application/x-gzip;" "application/x-bzip2;"
+        "application/x-bzip;" "application/x-zlib;" "application/x-deflate;"
+        ZSTD_CAPS LZ4_CAPS)
     );
 
+static GstStaticCaps typefind_caps =
+    GST_STATIC_CAPS ("application/x-gzip;" "application/x-bzip2;"
+        ZSTD_CAPS LZ4_CAPS);
+
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("ANY")
     );
 
+#define GST_TYPE_GZDEC_BACKEND (gst_gzdec_backend_get_type ())
+static GType
+gst_gzdec_backend_get_type (void)
+{
+  static GType backend_type = 0;
+  static const GEnumValue backends[] = {
+    {GST_GZDEC_BACKEND_AUTO, "Fastest one compiled in", "auto"},
+    {GST_GZDEC_BACKEND_ZLIB, "zlib", "zlib"},
+    {GST_GZDEC_BACKEND_LIBDEFLATE,
+        "libdeflate for members within one buffer, zlib otherwise",
+        "libdeflate"},
+    {0, NULL, NULL}
+  };
+
+  if (! backend_type)
+    backend_type = g_enum_register_static ("GstGzdecBackend", backends);
+
+  return backend_type;
+}
+
+#define GST_TYPE_GZDEC_VERIFY (gst_gzdec_verify_get_type ())
+static GType
+gst_gzdec_verify_get_type (void)
+{
+  static GType verify_type = 0;
+  static const GEnumValue modes[] = {
+    {GST_GZDEC_VERIFY_FULL, "Checked by the decoding library", "full"},
+    {GST_GZDEC_VERIFY_HARDWARE,
+        "gzip CRC-32 computed with CPU instructions next to zlib",
+        "hardware"},
+    {GST_GZDEC_VERIFY_OFF, "Not checked", "off"},
+    {0, NULL, NULL}
+  };
+
+  if (! verify_type)
+    verify_type = g_enum_register_static ("GstGzdecVerify", modes);
+
+  return verify_type;
+}
+
+#define GST_TYPE_GZDEC_WORKER_AFFINITY (gst_gzdec_worker_affinity_get_type ())
+static GType
+gst_gzdec_worker_affinity_get_type (void)
+{
+  static GType affinity_type = 0;
+  static const GEnumValue affinities[] = {
+    {GST_GZDEC_WORKER_AFFINITY_NONE, "Left to the scheduler", "none"},
+    {GST_GZDEC_WORKER_AFFINITY_CPU,
+        "Each worker on one CPU, NUMA nodes in turn", "cpu"},
+    {GST_GZDEC_WORKER_AFFINITY_NODE,
+        "Each worker on the CPUs of one NUMA node, nodes in turn", "node"},
+    {0, NULL, NULL}
+  };
+
+  if (! affinity_type)
+    affinity_type = g_enum_register_static ("GstGzdecWorkerAffinity",
+        affinities);
+
+  return affinity_type;
+}
+
+#define GST_TYPE_GZDEC_INPUT_FORMAT (gst_gzdec_input_format_get_type ())
+static GType
+gst_gzdec_input_format_get_type (void)
+{
+  static GType format_type = 0;
+  static const GEnumValue formats[] = {
+    {GST_GZDEC_INPUT_FORMAT_AUTO, "Detected from the data and the caps",
+        "auto"},
+    {GST_GZDEC_INPUT_FORMAT_ZLIB, "zlib (RFC 1950)", "zlib"},
+    {GST_GZDEC_INPUT_FORMAT_DEFLATE, "Raw deflate (RFC 1951)", "deflate"},
+    {0, NULL, NULL}
+  };
+
+  if (! format_type)
+    format_type = g_enum_register_static ("GstGzdecInputFormat", formats);
+
+  return format_type;
+}
+
 #define gst_gzdec_parent_class parent_class
 G_DEFINE_TYPE (GstGzdec, gst_gzdec, GST_TYPE_ELEMENT);
 
-GST_ELEMENT_REGISTER_DEFINE (gzdec, "gzdec", GST_RANK_NONE,
+// Ranked for decodebin to autoplug, below dedicated decoders
+GST_ELEMENT_REGISTER_DEFINE (gzdec, "gzdec", GST_RANK_MARGINAL,
     GST_TYPE_GZDEC);
 
+static void gst_gzdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_gzdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_gzdec_finalize (GObject * object);
+
+static GstStateChangeReturn gst_gzdec_change_state (GstElement * element,
+    GstStateChange transition);
+
 static GstFlowReturn gst_gzdec_chain (GstPad    *pad,
     GstObject *parent, GstBuffer *buf);
+static GstFlowReturn gst_gzdec_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list);
+static GstFlowReturn gst_gzdec_process (GstGzdec * filter, GstBuffer ** bufs,
+    guint n_bufs);
+static GstFlowReturn gst_gzdec_batch_add (GstGzdec * filter,
+    GstBuffer * buf);
+static GstFlowReturn gst_gzdec_batch_flush (GstGzdec * filter);
+static void gst_gzdec_batch_clear (GstGzdec * filter);
 static gboolean gst_gzdec_sink_event (GstPad    *pad,
     GstObject *parent, GstEvent  *event);
+static gboolean gst_gzdec_handle_event (GstGzdec * filter, GstEvent * event);
+static GstFlowReturn gst_gzdec_async_queue (GstGzdec * filter,
+    GstMiniObject * item);
+static gboolean gst_gzdec_sink_activate (GstPad * pad, GstObject * parent);
+static gboolean gst_gzdec_sink_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+static void gst_gzdec_loop (GstPad * pad);
+static void gst_gzdec_open_mapping (GstGzdec * filter);
+static GstFlowReturn gst_gzdec_map_range (GstGzdec * filter, guint64 offset,
+    guint size, GstBuffer ** buf);
+static gboolean gst_gzdec_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+static void gst_gzdec_async_loop (GstPad * pad);
+static gboolean gst_gzdec_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_gzdec_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
 
 // Private methods
 
+static void gst_gzdec_decide_allocation (GstGzdec * filter);
+static void gst_gzdec_clear_allocation (GstGzdec * filter);
+
+static gsize gst_gzdec_chunk_size (GstGzdec * filter, gsize avail_in);
+static GstFlowReturn gst_gzdec_output_reserve (GstGzdec * filter,
+    gsize avail_in, guint8 ** data, gsize * size);
+static GstFlowReturn gst_gzdec_output_commit (GstGzdec * filter,
+    GstBuffer ** outbuf, gsize produced);
+static void gst_gzdec_output_finish (GstGzdec * filter, GstBuffer ** outbuf);
+static GstFlowReturn gst_gzdec_output_check (GstGzdec * filter,
+    GstBuffer ** outbuf, gsize pending);
+static GstFlowReturn gst_gzdec_output_push (GstGzdec * filter,
+    GstBuffer ** outbuf);
+static void gst_gzdec_output_discard (GstGzdec * filter);
+static GstFlowReturn gst_gzdec_output_append (GstGzdec * filter,
+    GstBuffer ** outbuf, GstMemory * mem);
+
+static GstFlowReturn gst_gzdec_parallel_flush (GstGzdec * filter,
+    GstBuffer ** outbuf, gboolean wait);
+static void gst_gzdec_parallel_keep (GstGzdec * filter,
+    const guint8 * data, gsize size, gsize consumed);
+static void gst_gzdec_stop_parallel (GstGzdec * filter);
+static void gst_gzdec_release_decoder (GstGzdec * filter);
+static void gst_gzdec_drain (GstGzdec * filter);
+static GstFlowReturn gst_gzdec_push (GstGzdec * filter, GstBuffer * buf);
+static void gst_gzdec_mark_member (GstGzdec * filter, guint member,
+    guint64 in, guint64 out);
+static void gst_gzdec_add_member_meta (GstGzdec * filter, GstBuffer * buf,
+    guint64 start);
+static GstFlowReturn gst_gzdec_push_records (GstGzdec * filter,
+    GstBuffer * buf);
+static void gst_gzdec_records_drain (GstGzdec * filter);
+static void gst_gzdec_records_clear (GstGzdec * filter);
+static GstFlowReturn gst_gzdec_pad_push (GstGzdec * filter, GstBuffer * buf);
+static GstFlowReturn gst_gzdec_push_buffer (GstGzdec * filter,
+    GstBuffer * buf);
+static GstEvent * gst_gzdec_convert_segment (GstGzdec * filter,
+    GstEvent * event);
+static gboolean gst_gzdec_push_segment (GstGzdec * filter, GstEvent * event);
+static GstFlowReturn gst_gzdec_typefind (GstGzdec * filter, GstBuffer * buf,
+    gboolean force);
+static void gst_gzdec_typefind_reset (GstGzdec * filter);
+static void gst_gzdec_reposition (GstGzdec * filter, guint64 target);
+static void gst_gzdec_open_index (GstGzdec * filter);
+static void gst_gzdec_close_index (GstGzdec * filter);
+static void gst_gzdec_complete_index (GstGzdec * filter);
+static void gst_gzdec_reset_stats (GstGzdec * filter);
+static GstStructure * gst_gzdec_get_stats (GstGzdec * filter);
+static void gst_gzdec_add_decode_time (GstGzdec * filter,
+    GstClockTime elapsed);
+static void gst_gzdec_post_stats (GstGzdec * filter, gboolean force);
+
+static gboolean gst_gzdec_detect_format (GstGzdec * filter,
+    GstBuffer * buf);
+static void gst_gzdec_select_decoder (GstGzdec * filter);
+static GstFlowReturn gst_gzdec_encode (GstGzdec * filter,
+    GstBuffer ** inbufs, guint n_inbufs, GstBuffer ** outbuf);
+static GstFlowReturn gst_gzdec_decode (GstGzdec * filter,
+    const guint8 * data, gsize size, GstBuffer ** outbuf);
+
 static gboolean zlib_init_encoder (GstGzdec *);
 static gboolean zlib_free_encoder (GstGzdec *);
-static GstFlowReturn zlib_encode (GstGzdec * filter,
-    GstBuffer * inbuf, GstBuffer ** outbuf);
+static gboolean zlib_reset_encoder (GstGzdec *);
+static GstGzdecStep zlib_step (GstGzdec * filter, const guint8 ** in,
+    gsize * in_size, guint8 ** out, gsize * out_size);
+static GstFlowReturn gst_gzdec_decode_frames (GstGzdec * filter,
+    const guint8 * data, gsize size, GstBuffer ** outbuf);
+
+#ifdef HAVE_LIBDEFLATE
+static gboolean libdeflate_init_encoder (GstGzdec *);
+static gboolean libdeflate_free_encoder (GstGzdec *);
+static GstFlowReturn libdeflate_decode (GstGzdec * filter,
+    const guint8 * data, gsize size, GstBuffer ** outbuf);
+#endif
+
+#ifdef HAVE_ZSTD
+static gboolean zstd_init_encoder (GstGzdec *);
+static gboolean zstd_free_encoder (GstGzdec *);
+static gboolean zstd_reset_encoder (GstGzdec *);
+static GstGzdecStep zstd_step (GstGzdec * filter, const guint8 ** in,
+    gsize * in_size, guint8 ** out, gsize * out_size);
+#endif
+
+#ifdef HAVE_LZ4
+static gboolean lz4_init_encoder (GstGzdec *);
+static gboolean lz4_free_encoder (GstGzdec *);
+static gboolean lz4_reset_encoder (GstGzdec *);
+static GstGzdecStep lz4_step (GstGzdec * filter, const guint8 ** in,
+    gsize * in_size, guint8 ** out, gsize * out_size);
+#endif
 
 static gboolean bzlib_init_encoder (GstGzdec *);
 static gboolean bzlib_free_encoder (GstGzdec *);
-static GstFlowReturn bzlib_encode (GstGzdec * filter,
-    GstBuffer * inbuf, GstBuffer ** outbuf);
+static gboolean bzlib_reset_encoder (GstGzdec *);
+static GstGzdecStep bzlib_step (GstGzdec * filter, const guint8 ** in,
+    gsize * in_size, guint8 ** out, gsize * out_size);
+static GstFlowReturn bzlib_decode_parallel (GstGzdec * filter,
+    const guint8 * data, gsize size, GstBuffer ** outbuf);
 
 /* GObject vmethod implementations */
 
@@ -126,14 +447,224 @@ static GstFlowReturn bzlib_encode (GstGzdec * filter,
 static void
 gst_gzdec_class_init (GstGzdecClass * klass)
 {
+  GObjectClass *gobject_class;
   GstElementClass *element_class;
 
+  gobject_class = (GObjectClass *) klass;
   element_class = (GstElementClass *) klass;
 
+  gobject_class->set_property = gst_gzdec_set_property;
+  gobject_class->get_property = gst_gzdec_get_property;
+  gobject_class->finalize     = gst_gzdec_finalize;
+
+  element_class->change_state = GST_DEBUG_FUNCPTR (gst_gzdec_change_state);
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_CHUNK_SIZE,
+      g_param_spec_uint ("output-chunk-size", "Output chunk size",
+          "Size of the memory block each decompression step writes into. "
+          "In adaptive mode this is the lower bound of the chunk size",
+          64, MAX_OUT_BUF_SIZE, DEFAULT_OUTPUT_CHUNK_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_CHUNK_SIZE,
+      g_param_spec_boolean ("adaptive-chunk-size", "Adaptive chunk size",
+          "Size output chunks from the compression ratio seen so far, "
+          "up to 1 MiB per chunk",
+          DEFAULT_ADAPTIVE_CHUNK_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CONTIGUOUS_OUTPUT,
+      g_param_spec_boolean ("contiguous-output", "Contiguous output",
+          "Decode each input buffer into a single memory block instead of "
+          "a list of output-chunk-size blocks",
+          DEFAULT_CONTIGUOUS_OUTPUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_USE_BUFFER_POOL,
+      g_param_spec_boolean ("use-buffer-pool", "Use buffer pool",
+          "Decode into buffers of output-chunk-size bytes from the pool "
+          "proposed by downstream, or from an internal pool if downstream "
+          "has none. Every filled buffer is pushed on its own",
+          DEFAULT_USE_BUFFER_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_OUTPUT_BUFFER_SIZE,
+      g_param_spec_uint ("max-output-buffer-size", "Max output buffer size",
+          "Push decoded data as soon as this many bytes are pending and "
+          "continue decoding the same input afterwards (0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_MAX_OUTPUT_BUFFER_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Push decoded data as soon as each decompression step returns "
+          "instead of collecting the output of a whole input buffer",
+          DEFAULT_LOW_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of worker threads decoding BGZF gzip blocks, bzip2 "
+          "blocks and zstd or LZ4 frames in parallel. 0 = one per CPU, "
+          "1 = decode on the streaming thread. Read when the stream "
+          "starts",
+          0, 1024, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WORKER_AFFINITY,
+      g_param_spec_enum ("worker-affinity", "Worker affinity",
+          "Pin the worker threads so that each one, its decoder state and "
+          "the output it allocates stay on one CPU or NUMA node. Linux "
+          "only. Read when the stream starts",
+          GST_TYPE_GZDEC_WORKER_AFFINITY, DEFAULT_WORKER_AFFINITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MMAP,
+      g_param_spec_boolean ("mmap", "mmap",
+          "In pull mode, decode straight from a read-only mapping of the "
+          "local file upstream reads from instead of pulling buffers. The "
+          "file must not shrink while it is being decoded. Read when the "
+          "stream starts",
+          DEFAULT_MMAP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BACKEND,
+      g_param_spec_enum ("backend", "Backend",
+          "Library inflating gzip streams. Backends that were not compiled "
+          "in fall back to zlib. Read when the stream starts",
+          GST_TYPE_GZDEC_BACKEND, DEFAULT_BACKEND,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VERIFY,
+      g_param_spec_enum ("verify", "Verify",
+          "Check of the gzip CRC-32 and size, the zlib Adler-32 and the "
+          "bzip2 stream CRC. With off, corrupt data may go undetected. "
+          "libdeflate and libbz2 always check what they decode, so the "
+          "auto backend is zlib then. Read when the stream starts",
+          GST_TYPE_GZDEC_VERIFY, DEFAULT_VERIFY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INDEX_SPAN,
+      g_param_spec_uint ("index-span", "Index span",
+          "Decoded bytes between seek index checkpoints, each of which "
+          "keeps a 32 KiB window. Checkpoints are recorded in pull mode "
+          "while inflating gzip with zlib (0 = no index)",
+          0, G_MAXUINT, DEFAULT_INDEX_SPAN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+      g_param_spec_string ("index-location", "Index location",
+          "Sidecar file holding the seek index and the bzip2 block table "
+          "of the stream. Loaded when the stream starts if it exists and "
+          "matches the stream, an index is also built in push mode",
+          DEFAULT_INDEX_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INDEX_WRITE,
+      g_param_spec_boolean ("index-write", "Index write",
+          "Save the index to index-location when stopping if it has "
+          "grown since it was loaded",
+          DEFAULT_INDEX_WRITE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Bytes in and out of the current stream, compression ratio, "
+          "buffers decoded, output chunks allocated, time spent decoding "
+          "and blocked in pushing downstream (ns), and a histogram of the "
+          "decode time per input buffer in power of two microseconds",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Post the statistics as an element message at most every this "
+          "many milliseconds while decoding, and at EOS (0 = never)",
+          0, G_MAXUINT, DEFAULT_STATS_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TYPEFIND,
+      g_param_spec_boolean ("typefind", "Typefind",
+          "Typefind the first decoded bytes and set the src caps, using the "
+          "original file name of gzip streams as a hint, instead of leaving "
+          "it to a typefind element downstream",
+          DEFAULT_TYPEFIND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ASYNC,
+      g_param_spec_boolean ("async", "Async",
+          "Queue input and decode it on a thread of its own in push mode, "
+          "so upstream, decoding and downstream run in parallel. Read when "
+          "going to PAUSED",
+          DEFAULT_ASYNC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_LEVEL_BYTES,
+      g_param_spec_uint ("max-level-bytes", "Max level bytes",
+          "Compressed bytes queued in async mode before upstream blocks",
+          1, G_MAXINT / 2, DEFAULT_MAX_LEVEL_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_INPUT_BYTES,
+      g_param_spec_uint ("min-input-bytes", "Min input bytes",
+          "Gather smaller input buffers, e.g. from udpsrc or a depayloader, "
+          "and decode them together into one output buffer once they hold "
+          "this many bytes (0 = decode every buffer on its own)",
+          0, G_MAXINT, DEFAULT_MIN_INPUT_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_INPUT_LATENCY,
+      g_param_spec_uint64 ("max-input-latency", "Max input latency",
+          "Longest time in ns input is gathered for min-input-bytes. Checked "
+          "when the next buffer arrives, and by the src pad task in async "
+          "mode while none does",
+          0, G_MAXUINT64, DEFAULT_MAX_INPUT_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MEMBER_META,
+      g_param_spec_boolean ("member-meta", "Member meta",
+          "Attach a GstGzdecMeta with the member index and compressed offset "
+          "each output buffer starts at, for re-reading a range later",
+          DEFAULT_MEMBER_META,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FORMAT,
+      g_param_spec_enum ("format", "Format",
+          "Take the input as zlib or raw deflate instead of detecting its "
+          "format, e.g. for messages too short to tell",
+          GST_TYPE_GZDEC_INPUT_FORMAT, DEFAULT_FORMAT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WINDOW_BITS,
+      g_param_spec_uint ("window-bits", "Window bits",
+          "Base two logarithm of the window for zlib and raw deflate "
+          "streams. Smaller windows take less memory, the stream must have "
+          "been compressed with one no larger",
+          8, 15, DEFAULT_WINDOW_BITS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DICTIONARY,
+      g_param_spec_boxed ("dictionary", "Dictionary",
+          "Preset dictionary for zlib and raw deflate streams",
+          G_TYPE_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECORDS_PER_BUFFER,
+      g_param_spec_uint ("records-per-buffer", "Records per buffer",
+          "Cut the output into buffers of this many newline terminated "
+          "records each (0 = push output as it is decoded). A buffer is "
+          "cut short at max-output-buffer-size, 1 MiB without it",
+          0, G_MAXUINT, DEFAULT_RECORDS_PER_BUFFER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECORD_META,
+      g_param_spec_boolean ("record-meta", "Record meta",
+          "Attach a GstGzdecRecordMeta with the ends of the newline "
+          "terminated records to each output buffer",
+          DEFAULT_RECORD_META,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_set_details_simple (element_class,
       "Gzdec",
-      "gzip/bzip2 stream decoder",
-      "Decoder capable of unarchiving gzip and bzip2 streams",
+      "Codec/Decoder",
+      "Decoder capable of unarchiving gzip, bzip2, zstd and LZ4 streams",
       "Eugene Bulavin <eugene.bulavin.se@gmail.com>");
 
   gst_element_class_add_pad_template (element_class,
@@ -150,225 +681,3690 @@ gst_gzdec_class_init (GstGzdecClass * klass)
 static void
 gst_gzdec_init (GstGzdec * filter)
 {
-  memset(&filter->zlib_stream, 0, sizeof(filter->zlib_stream));
+  filter->zlib_stream = NULL;
+  filter->zlib_window_bits = 0;
+  filter->zlib_check       = FALSE;
+  filter->member_crc       = 0;
   memset(&filter->bzlib_stream, 0, sizeof(filter->bzlib_stream));
   
   filter->sinkpad = gst_pad_new_from_static_template (&sink_factory, "sink");
   gst_pad_set_chain_function (filter->sinkpad,
       GST_DEBUG_FUNCPTR (gst_gzdec_chain));
+  gst_pad_set_chain_list_function (filter->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_gzdec_chain_list));
   gst_pad_set_event_function(filter->sinkpad,
       GST_DEBUG_FUNCPTR (gst_gzdec_sink_event));
+  gst_pad_set_activate_function (filter->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_gzdec_sink_activate));
+  gst_pad_set_activatemode_function (filter->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_gzdec_sink_activate_mode));
   gst_element_add_pad (GST_ELEMENT (filter), filter->sinkpad);
 
   filter->srcpad = gst_pad_new_from_static_template (&src_factory, "src");
   GST_PAD_SET_PROXY_CAPS (filter->srcpad);
+  gst_pad_set_activatemode_function (filter->srcpad,
+      GST_DEBUG_FUNCPTR (gst_gzdec_src_activate_mode));
+  gst_pad_set_event_function (filter->srcpad,
+      GST_DEBUG_FUNCPTR (gst_gzdec_src_event));
+  gst_pad_set_query_function (filter->srcpad,
+      GST_DEBUG_FUNCPTR (gst_gzdec_src_query));
   gst_element_add_pad (GST_ELEMENT (filter), filter->srcpad);
 
   filter->in_progress  = FALSE;
-  // Default encoder is ZLIB
-  filter->init_encoder = zlib_init_encoder;
-  filter->free_encoder = zlib_free_encoder;
-  filter->encode       = zlib_encode;
-}
+  filter->pull_offset  = 0;
+  filter->pull_started = FALSE;
+  filter->mapping      = NULL;
+  filter->need_segment = FALSE;
+  filter->pushed_out   = 0;
+  filter->duration     = -1;
+  filter->duration_probed = FALSE;
+  gst_segment_init (&filter->segment, GST_FORMAT_BYTES);
+  filter->typefind_done    = FALSE;
+  filter->typefind_buf     = NULL;
+  filter->typefind_segment = NULL;
+  filter->typefind_hint    = NULL;
 
-/* GstBaseTransform vmethod implementations */
-static GstFlowReturn gst_gzdec_chain (GstPad    *pad,
-    GstObject *parent, GstBuffer *buf)
-{
-  GstGzdec * filter = GST_GZDEC (parent);
-  GstFlowReturn ret = GST_FLOW_OK;
-  GstBuffer * outbuf;
+  filter->output_chunk_size   = DEFAULT_OUTPUT_CHUNK_SIZE;
+  filter->adaptive_chunk_size = DEFAULT_ADAPTIVE_CHUNK_SIZE;
+  filter->contiguous_output   = DEFAULT_CONTIGUOUS_OUTPUT;
+  filter->use_buffer_pool     = DEFAULT_USE_BUFFER_POOL;
+  filter->max_output_buffer_size = DEFAULT_MAX_OUTPUT_BUFFER_SIZE;
+  filter->low_latency         = DEFAULT_LOW_LATENCY;
+  filter->threads             = DEFAULT_THREADS;
+  filter->worker_affinity     = DEFAULT_WORKER_AFFINITY;
+  filter->use_mmap            = DEFAULT_MMAP;
+  filter->backend             = DEFAULT_BACKEND;
+  filter->verify              = DEFAULT_VERIFY;
+  filter->index_span          = DEFAULT_INDEX_SPAN;
+  filter->index_location      = g_strdup (DEFAULT_INDEX_LOCATION);
+  filter->index_write         = DEFAULT_INDEX_WRITE;
+  filter->stats_interval      = DEFAULT_STATS_INTERVAL;
+  filter->typefind            = DEFAULT_TYPEFIND;
+  filter->async               = DEFAULT_ASYNC;
+  filter->max_level_bytes     = DEFAULT_MAX_LEVEL_BYTES;
+  filter->min_input_bytes     = DEFAULT_MIN_INPUT_BYTES;
+  filter->max_input_latency   = DEFAULT_MAX_INPUT_LATENCY;
+  filter->member_meta         = DEFAULT_MEMBER_META;
+  filter->input_format        = DEFAULT_FORMAT;
+  filter->window_bits         = DEFAULT_WINDOW_BITS;
+  filter->dictionary          = NULL;
+  filter->caps_format         = GST_GZDEC_INPUT_FORMAT_AUTO;
+  filter->caps_named          = FALSE;
+  filter->detect_buf          = NULL;
+  filter->draining            = FALSE;
+  filter->records_per_buffer  = DEFAULT_RECORDS_PER_BUFFER;
+  filter->record_meta         = DEFAULT_RECORD_META;
+  filter->record_pending      = NULL;
+  filter->record_ends         = g_array_new (FALSE, FALSE, sizeof (gsize));
+  filter->ring                = NULL;
+  filter->batch               = g_ptr_array_new ();
+  filter->batch_bytes         = 0;
+  filter->batch_deadline      = 0;
+  filter->batch_flow          = GST_FLOW_OK;
+  gst_gzdec_reset_stats (filter);
 
-  if (G_UNLIKELY(! filter->in_progress)) {
-    if (! filter->init_encoder (filter))
-      goto not_supported;
+  filter->index         = NULL;
+  filter->index_checked = FALSE;
+  filter->raw_member    = FALSE;
+  filter->skip_in       = 0;
 
-    filter->in_progress = TRUE;
-  }
-  
-  ret = filter->encode (filter, buf, &outbuf);
-  gst_buffer_unref (buf);
+  filter->parallel    = NULL;
+  filter->par_pending = NULL;
+  filter->par_probed  = FALSE;
+  filter->par_bit     = 0;
+  filter->par_scan    = 0;
+  filter->par_level   = 0;
+  filter->par_crc     = 0;
+  filter->par_failed  = NULL;
+  filter->par_member_in = -1;
 
-  gst_pad_push(filter->srcpad, outbuf);
+  filter->allocation_decided = FALSE;
+  filter->allocator          = NULL;
+  filter->pool               = NULL;
+  gst_allocation_params_init (&filter->params);
 
-  if (ret == GST_FLOW_EOS) {
-    filter->free_encoder (filter);
-    filter->in_progress = FALSE;
+  filter->out_pooled = NULL;
+  filter->out_memory = NULL;
+  filter->out_data   = NULL;
+  filter->out_size   = 0;
+  filter->out_alloc  = 0;
+
+  filter->bytes_in  = 0;
+  filter->bytes_out = 0;
+  filter->members   = 0;
+  filter->member_out = 0;
+  filter->trailing_garbage = FALSE;
+  filter->marks      = g_array_new (FALSE, FALSE, sizeof (GstGzdecMark));
+  filter->members_counted = TRUE;
+
+  filter->deflate       = NULL;
+  filter->zstd_dctx     = NULL;
+  filter->lz4_dctx      = NULL;
+  filter->decoder_error = 0;
+
+  // Default format is gzip
+  filter->format = GST_GZDEC_FORMAT_GZIP;
+  gst_gzdec_select_decoder (filter);
+}
+
+static void
+gst_gzdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstGzdec *filter = GST_GZDEC (object);
+
+  switch (prop_id) {
+    case PROP_OUTPUT_CHUNK_SIZE:
+      filter->output_chunk_size = g_value_get_uint (value);
+      break;
+    case PROP_ADAPTIVE_CHUNK_SIZE:
+      filter->adaptive_chunk_size = g_value_get_boolean (value);
+      break;
+    case PROP_CONTIGUOUS_OUTPUT:
+      filter->contiguous_output = g_value_get_boolean (value);
+      break;
+    case PROP_USE_BUFFER_POOL:
+      filter->use_buffer_pool = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_OUTPUT_BUFFER_SIZE:
+      filter->max_output_buffer_size = g_value_get_uint (value);
+      break;
+    case PROP_LOW_LATENCY:
+      filter->low_latency = g_value_get_boolean (value);
+      break;
+    case PROP_THREADS:
+      filter->threads = g_value_get_uint (value);
+      break;
+    case PROP_WORKER_AFFINITY:
+      filter->worker_affinity = g_value_get_enum (value);
+      break;
+    case PROP_MMAP:
+      filter->use_mmap = g_value_get_boolean (value);
+      break;
+    case PROP_BACKEND:
+      filter->backend = g_value_get_enum (value);
+      break;
+    case PROP_VERIFY:
+      filter->verify = g_value_get_enum (value);
+      break;
+    case PROP_INDEX_SPAN:
+      filter->index_span = g_value_get_uint (value);
+      break;
+    case PROP_INDEX_LOCATION:
+      g_free (filter->index_location);
+      filter->index_location = g_value_dup_string (value);
+      break;
+    case PROP_INDEX_WRITE:
+      filter->index_write = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      filter->stats_interval = g_value_get_uint (value);
+      break;
+    case PROP_TYPEFIND:
+      filter->typefind = g_value_get_boolean (value);
+      break;
+    case PROP_ASYNC:
+      filter->async = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_LEVEL_BYTES:
+      GST_OBJECT_LOCK (filter);
+      filter->max_level_bytes = g_value_get_uint (value);
+      if (filter->ring != NULL)
+        gst_gzdec_ring_set_max_level (filter->ring, filter->max_level_bytes);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_MIN_INPUT_BYTES:
+      filter->min_input_bytes = g_value_get_uint (value);
+      // Batching adds up to max-input-latency, see gst_gzdec_src_query
+      gst_element_post_message (GST_ELEMENT (filter),
+          gst_message_new_latency (GST_OBJECT (filter)));
+      break;
+    case PROP_MAX_INPUT_LATENCY:
+      filter->max_input_latency = g_value_get_uint64 (value);
+      gst_element_post_message (GST_ELEMENT (filter),
+          gst_message_new_latency (GST_OBJECT (filter)));
+      break;
+    case PROP_MEMBER_META:
+      filter->member_meta = g_value_get_boolean (value);
+      break;
+    case PROP_FORMAT:
+      filter->input_format = g_value_get_enum (value);
+      break;
+    case PROP_WINDOW_BITS:
+      filter->window_bits = g_value_get_uint (value);
+      break;
+    case PROP_DICTIONARY:
+      GST_OBJECT_LOCK (filter);
+      g_clear_pointer (&filter->dictionary, g_bytes_unref);
+      filter->dictionary = g_value_dup_boxed (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_RECORDS_PER_BUFFER:
+      filter->records_per_buffer = g_value_get_uint (value);
+      break;
+    case PROP_RECORD_META:
+      filter->record_meta = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
   }
-  
-  return ret;
+}
 
- not_supported:
-  {
-    gst_buffer_unref (buf);
-    GST_WARNING_OBJECT (parent, "could not invoke encoder, input unsupported");
-    return GST_FLOW_NOT_NEGOTIATED;
+static void
+gst_gzdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstGzdec *filter = GST_GZDEC (object);
+
+  switch (prop_id) {
+    case PROP_OUTPUT_CHUNK_SIZE:
+      g_value_set_uint (value, filter->output_chunk_size);
+      break;
+    case PROP_ADAPTIVE_CHUNK_SIZE:
+      g_value_set_boolean (value, filter->adaptive_chunk_size);
+      break;
+    case PROP_CONTIGUOUS_OUTPUT:
+      g_value_set_boolean (value, filter->contiguous_output);
+      break;
+    case PROP_USE_BUFFER_POOL:
+      g_value_set_boolean (value, filter->use_buffer_pool);
+      break;
+    case PROP_MAX_OUTPUT_BUFFER_SIZE:
+      g_value_set_uint (value, filter->max_output_buffer_size);
+      break;
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value, filter->low_latency);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, filter->threads);
+      break;
+    case PROP_WORKER_AFFINITY:
+      g_value_set_enum (value, filter->worker_affinity);
+      break;
+    case PROP_MMAP:
+      g_value_set_boolean (value, filter->use_mmap);
+      break;
+    case PROP_BACKEND:
+      g_value_set_enum (value, filter->backend);
+      break;
+    case PROP_VERIFY:
+      g_value_set_enum (value, filter->verify);
+      break;
+    case PROP_INDEX_SPAN:
+      g_value_set_uint (value, filter->index_span);
+      break;
+    case PROP_INDEX_LOCATION:
+      g_value_set_string (value, filter->index_location);
+      break;
+    case PROP_INDEX_WRITE:
+      g_value_set_boolean (value, filter->index_write);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_gzdec_get_stats (filter));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, filter->stats_interval);
+      break;
+    case PROP_TYPEFIND:
+      g_value_set_boolean (value, filter->typefind);
+      break;
+    case PROP_ASYNC:
+      g_value_set_boolean (value, filter->async);
+      break;
+    case PROP_MAX_LEVEL_BYTES:
+      g_value_set_uint (value, filter->max_level_bytes);
+      break;
+    case PROP_MIN_INPUT_BYTES:
+      g_value_set_uint (value, filter->min_input_bytes);
+      break;
+    case PROP_MAX_INPUT_LATENCY:
+      g_value_set_uint64 (value, filter->max_input_latency);
+      break;
+    case PROP_MEMBER_META:
+      g_value_set_boolean (value, filter->member_meta);
+      break;
+    case PROP_FORMAT:
+      g_value_set_enum (value, filter->input_format);
+      break;
+    case PROP_WINDOW_BITS:
+      g_value_set_uint (value, filter->window_bits);
+      break;
+    case PROP_DICTIONARY:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_boxed (value, filter->dictionary);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_RECORDS_PER_BUFFER:
+      g_value_set_uint (value, filter->records_per_buffer);
+      break;
+    case PROP_RECORD_META:
+      g_value_set_boolean (value, filter->record_meta);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
   }
 }
 
-static gboolean gst_gzdec_sink_event (GstPad    *pad,
-    GstObject *parent, GstEvent  *event)
+static void
+gst_gzdec_finalize (GObject * object)
 {
-  gboolean ret;
-  GstGzdec *filter = GST_GZDEC (parent);
+  GstGzdec *filter = GST_GZDEC (object);
 
-  switch (GST_EVENT_TYPE (event)) {
-  case GST_EVENT_CAPS:
-    {
-      GstCaps *caps;
-      GstStructure *s;
+  g_free (filter->index_location);
+  gst_gzdec_batch_clear (filter);
+  g_ptr_array_unref (filter->batch);
+  g_array_unref (filter->marks);
+  g_clear_pointer (&filter->dictionary, g_bytes_unref);
+  gst_gzdec_records_clear (filter);
+  g_array_unref (filter->record_ends);
+#ifdef HAVE_ZSTD
+  g_clear_pointer (&filter->zstd_dctx, ZSTD_freeDCtx);
+#endif
+#ifdef HAVE_LZ4
+  g_clear_pointer (&filter->lz4_dctx, LZ4F_freeDecompressionContext);
+#endif
 
-      gst_event_parse_caps (event, &caps);
-      s = gst_caps_get_structure (caps, 0);
-      
-      if (gst_structure_has_name (s, "application/x-gzip")) {
-        filter->init_encoder = zlib_init_encoder;
-        filter->free_encoder = zlib_free_encoder;
-        filter->encode       = zlib_encode;
-        ret = TRUE;
-        break;
-      }
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
 
-      if (gst_structure_has_name (s, "application/x-bzip2")) {
-        filter->init_encoder = bzlib_init_encoder;
-        filter->free_encoder = bzlib_free_encoder;
-        filter->encode       = bzlib_encode;
-        ret = TRUE;
-        break;
-      }
+static GstStateChangeReturn
+gst_gzdec_change_state (GstElement * element, GstStateChange transition)
+{
+  GstGzdec *filter = GST_GZDEC (element);
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
 
-      ret = FALSE;
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_gzdec_release_decoder (filter);
+      gst_gzdec_output_discard (filter);
+      gst_gzdec_clear_allocation (filter);
+      gst_gzdec_close_index (filter);
+      filter->duration   = -1;
+      filter->duration_probed = FALSE;
+      gst_gzdec_typefind_reset (filter);
+      gst_gzdec_reset_stats (filter);
+      gst_gzdec_batch_clear (filter);
+      gst_gzdec_records_clear (filter);
+      filter->raw_member = FALSE;
+      filter->skip_in    = 0;
+      GST_OBJECT_LOCK (filter);
+      g_clear_pointer (&filter->ring, gst_gzdec_ring_free);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    default:
       break;
-    }
-  default:
-    ret = gst_pad_event_default (pad, parent, event);
-    break;
   }
+
   return ret;
 }
-/* Private methods implementation */
 
-static gboolean
-zlib_init_encoder (GstGzdec * filter)
+/* GstBaseTransform vmethod implementations */
+static GstFlowReturn gst_gzdec_chain (GstPad    *pad,
+    GstObject *parent, GstBuffer *buf)
 {
-  // Use system allocator
-  filter->zlib_stream.zalloc = Z_NULL;
-  filter->zlib_stream.zfree  = Z_NULL;
-  filter->zlib_stream.opaque = Z_NULL;
-  
-#define windowBits 15
-#define ENABLE_GZIP 16
+  GstGzdec * filter = GST_GZDEC (parent);
 
-  filter->zlib_stream.avail_in = 0;
-  filter->zlib_stream.next_in = Z_NULL;
-      
-  inflateInit2(&filter->zlib_stream, windowBits | ENABLE_GZIP);
-  
-  return TRUE;
-}
+  if (filter->ring != NULL)
+    return gst_gzdec_async_queue (filter, GST_MINI_OBJECT_CAST (buf));
 
-static gboolean
-zlib_free_encoder (GstGzdec * filter)
-{
-  inflateEnd(&filter->zlib_stream);
-  
-  return TRUE;
+  return gst_gzdec_batch_add (filter, buf);
 }
 
+/* Buffer lists, e.g. from RTP depayloaders, are decoded as one batch
+ * even without min-input-bytes.
+ */
 static GstFlowReturn
-zlib_encode (GstGzdec * filter,
-    GstBuffer * inbuf, GstBuffer ** outbuf)
+gst_gzdec_chain_list (GstPad * pad, GstObject * parent, GstBufferList * list)
 {
+  GstGzdec * filter = GST_GZDEC (parent);
   GstFlowReturn ret = GST_FLOW_OK;
-  GstMemory * memory_block;
-  GstMapInfo map_info_in, map_info_out;
-  int zlib_status = Z_OK;
-    
-  if (! gst_buffer_map(inbuf, &map_info_in, GST_MAP_READ))
-    return GST_FLOW_ERROR;
+  guint i, len = gst_buffer_list_length (list);
 
-  filter->zlib_stream.avail_in = map_info_in.size;
-  filter->zlib_stream.next_in  = map_info_in.data;
+  for (i = 0; i < len && ret == GST_FLOW_OK; i++) {
+    GstBuffer * buf = gst_buffer_ref (gst_buffer_list_get (list, i));
 
-  *outbuf = gst_buffer_new();
-  if (outbuf == NULL)
-    goto no_buffer;
-  
-  GST_BUFFER_OFFSET (*outbuf) = filter->zlib_stream.total_out;
-  gst_buffer_copy_into(inbuf, *outbuf, GST_BUFFER_COPY_METADATA, 0, -1);
+    // The batch belongs to the src pad task then
+    if (filter->ring != NULL)
+      ret = gst_gzdec_async_queue (filter, GST_MINI_OBJECT_CAST (buf));
+    else if (filter->min_input_bytes > 0)
+      ret = gst_gzdec_batch_add (filter, buf);
+    else
+      g_ptr_array_add (filter->batch, buf);
+  }
+  gst_buffer_list_unref (list);
 
-  while (filter->zlib_stream.avail_in > 0 && zlib_status != Z_STREAM_END) {
+  if (ret == GST_FLOW_OK && filter->ring == NULL
+      && filter->min_input_bytes == 0)
+    ret = gst_gzdec_batch_flush (filter);
+
+  return ret;
+}
 
-    memory_block = gst_allocator_alloc(NULL, OUT_BUF_SIZE, NULL);
+/* Queue buf to be decoded with the buffers before it. The batch is
+ * decoded once it holds min-input-bytes or max-input-latency has passed
+ * since its first buffer arrived. The buffers are kept by reference;
+ * their memories are decoded one after the other, as for a buffer of
+ * several memories.
+ */
+static GstFlowReturn
+gst_gzdec_batch_add (GstGzdec * filter, GstBuffer * buf)
+{
+  GstFlowReturn ret = filter->batch_flow;
+  gsize size = gst_buffer_get_size (buf);
 
-    if (! gst_memory_map(memory_block, &map_info_out, GST_MAP_WRITE))
-      goto map_error;
+  // What decoding the batch for an event returned
+  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
+    filter->batch_flow = GST_FLOW_OK;
+    gst_buffer_unref (buf);
+    return ret;
+  }
 
-    filter->zlib_stream.avail_out = map_info_out.size;
-    filter->zlib_stream.next_out  = map_info_out.data;
+  if (filter->batch->len == 0 && size >= filter->min_input_bytes)
+    return gst_gzdec_process (filter, &buf, 1);
 
-    zlib_status = inflate(&filter->zlib_stream, Z_NO_FLUSH);
-    switch (zlib_status) {
-    case Z_OK:
-    case Z_STREAM_END:
-    case Z_BUF_ERROR:
-      break;
-    default:
-      inflateEnd(&filter->zlib_stream);
-      goto decompress_error;
+  // A discontinuity starts a batch of its own, keeping its flag
+  if (GST_BUFFER_IS_DISCONT (buf) && filter->batch->len > 0) {
+    ret = gst_gzdec_batch_flush (filter);
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unref (buf);
+      return ret;
     }
-
-    gst_memory_unmap(memory_block, &map_info_out);
-    gst_memory_resize(memory_block, 0, OUT_BUF_SIZE - filter->zlib_stream.avail_out);
-    
-    gst_buffer_append_memory(*outbuf, memory_block);
   }
 
-  gst_buffer_unmap(inbuf, &map_info_in);
+  if (filter->batch->len == 0)
+    filter->batch_deadline = g_get_monotonic_time ()
+        + filter->max_input_latency / GST_USECOND;
+  g_ptr_array_add (filter->batch, buf);
+  filter->batch_bytes += size;
 
-  if (zlib_status == Z_STREAM_END)
-    return GST_FLOW_EOS;
-  
-  return GST_FLOW_OK;
+  if (filter->batch_bytes >= filter->min_input_bytes
+      || g_get_monotonic_time () >= filter->batch_deadline)
+    ret = gst_gzdec_batch_flush (filter);
 
- no_buffer:
-  {
-    gst_buffer_unmap(inbuf, &map_info_in);
-    GST_WARNING_OBJECT (filter, "could not allocate buffer");
-    return ret;
-  }
+  return ret;
+}
 
- map_error:
-  {
-    gst_buffer_unmap(inbuf, &map_info_in);
-    GST_WARNING_OBJECT (filter, "could not map memory object");
-    return ret;
-  }
+static GstFlowReturn
+gst_gzdec_batch_flush (GstGzdec * filter)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
 
- decompress_error:
-  {
-    gst_memory_unmap(memory_block, &map_info_out);
-    gst_buffer_unmap(inbuf, &map_info_in);
-    GST_WARNING_OBJECT (filter, "could not decompress stream: ZLIB_ERROR(%d)",
-         zlib_status);
-    return ret;
-  }
+  if (filter->batch->len > 0)
+    ret = gst_gzdec_process (filter, (GstBuffer **) filter->batch->pdata,
+        filter->batch->len);
+
+  g_ptr_array_set_size (filter->batch, 0);
+  filter->batch_bytes = 0;
+
+  return ret;
 }
 
-static gboolean
-bzlib_init_encoder (GstGzdec * filter)
+static void
+gst_gzdec_batch_clear (GstGzdec * filter)
+{
+  guint i;
+
+  for (i = 0; i < filter->batch->len; i++)
+    gst_buffer_unref (g_ptr_array_index (filter->batch, i));
+  g_ptr_array_set_size (filter->batch, 0);
+  gst_clear_buffer (&filter->detect_buf);
+  filter->batch_bytes = 0;
+  filter->batch_flow  = GST_FLOW_OK;
+}
+
+/* Start counting a new stream: decoded offsets, members and their marks
+ * begin at zero again.
+ */
+static void
+gst_gzdec_reset_stream (GstGzdec * filter)
+{
+  filter->bytes_in    = 0;
+  filter->bytes_out   = 0;
+  filter->members     = 0;
+  filter->member_out  = 0;
+  filter->pushed_out  = 0;
+  filter->trailing_garbage = FALSE;
+  filter->members_counted  = TRUE;
+  g_array_set_size (filter->marks, 0);
+  gst_gzdec_mark_member (filter, 0, 0, 0);
+}
+
+/* After a flush upstream sends data from the start of a stream again,
+ * e.g. when looping a file. Whatever was decoded or queued is dropped and
+ * the decoder is only reset, which allocates nothing; a decoder that
+ * resumed from the seek index inflates raw deflate and is released.
+ */
+static void
+gst_gzdec_flush (GstGzdec * filter)
+{
+  gst_gzdec_batch_clear (filter);
+  gst_gzdec_output_discard (filter);
+  gst_gzdec_stop_parallel (filter);
+  gst_clear_buffer (&filter->typefind_buf);
+  gst_gzdec_records_clear (filter);
+
+  if (filter->in_progress) {
+    if (filter->raw_member || filter->skip_in > 0
+        || ! filter->reset_encoder (filter))
+      gst_gzdec_release_decoder (filter);
+    filter->raw_member = FALSE;
+    filter->skip_in    = 0;
+  }
+
+  gst_gzdec_reset_stream (filter);
+  gst_segment_init (&filter->segment, GST_FORMAT_BYTES);
+}
+
+/* Decode input buffers, taking them over, and push the output as one
+ * buffer, on the upstream streaming thread, the sink pad task in pull
+ * mode or the src pad task in async mode. The start of a stream is held
+ * back until there is enough of it to tell the format, or EOS.
+ */
+static GstFlowReturn
+gst_gzdec_process (GstGzdec * filter, GstBuffer ** bufs, guint n_bufs)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer * outbuf;
+  GstClockTime start, push_time;
+  GstBuffer * gathered;
+  gsize size = 0;
+  guint i;
+
+  if (G_UNLIKELY (! filter->in_progress)) {
+    for (i = 0; i < n_bufs; i++)
+      size += gst_buffer_get_size (bufs[i]);
+
+    if (filter->detect_buf != NULL || size < DETECT_SIZE) {
+      for (i = 0; i < n_bufs; i++)
+        filter->detect_buf = filter->detect_buf != NULL
+            ? gst_buffer_append (filter->detect_buf, bufs[i]) : bufs[i];
+
+      if (gst_buffer_get_size (filter->detect_buf) < DETECT_SIZE
+          && ! filter->draining)
+        return GST_FLOW_OK;
+
+      gathered = g_steal_pointer (&filter->detect_buf);
+      bufs   = &gathered;
+      n_bufs = 1;
+    }
+
+    if (! gst_gzdec_detect_format (filter, bufs[0]))
+      goto not_supported;
+    gst_gzdec_select_decoder (filter);
+    if (! filter->init_encoder (filter))
+      goto not_supported;
+
+    gst_gzdec_reset_stream (filter);
+    filter->in_progress = TRUE;
+
+    if (filter->index == NULL)
+      gst_gzdec_open_index (filter);
+  }
+
+  if (gst_pad_check_reconfigure (filter->srcpad)
+      || G_UNLIKELY (! filter->allocation_decided))
+    gst_gzdec_decide_allocation (filter);
+  
+  outbuf = NULL;
+  start = gst_util_get_timestamp ();
+  push_time = filter->stats_push_time;
+  ret = filter->encode (filter, bufs, n_bufs, &outbuf);
+  for (i = 0; i < n_bufs; i++)
+    gst_buffer_unref (bufs[i]);
+  // Output pushed while decoding is accounted as push time
+  gst_gzdec_add_decode_time (filter, gst_util_get_timestamp () - start
+      - (filter->stats_push_time - push_time));
+
+  if (outbuf != NULL) {
+    // Nothing decoded yet, e.g. only a header arrived
+    if (gst_buffer_get_size (outbuf) == 0) {
+      gst_buffer_unref (outbuf);
+    } else if (ret == GST_FLOW_OK) {
+      GstFlowReturn push_ret = gst_gzdec_push (filter, outbuf);
+      if (push_ret != GST_FLOW_OK)
+        ret = push_ret;
+    } else {
+      gst_buffer_unref (outbuf);
+    }
+  }
+
+  if (filter->stats_interval > 0)
+    gst_gzdec_post_stats (filter, FALSE);
+
+  return ret;
+
+ not_supported:
+  {
+    for (i = 0; i < n_bufs; i++)
+      gst_buffer_unref (bufs[i]);
+    GST_WARNING_OBJECT (filter, "could not invoke encoder, input unsupported");
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+}
+
+/* Format for one of the sink template structures, FALSE for any other.
+ * zlib and raw deflate have no magic, so those caps are trusted like the
+ * format property.
+ */
+static gboolean
+gst_gzdec_format_from_caps (GstGzdec * filter, const GstStructure * s)
+{
+  filter->caps_format = GST_GZDEC_INPUT_FORMAT_AUTO;
+  filter->caps_named  = TRUE;
+
+  if (gst_structure_has_name (s, "application/x-gzip"))
+    filter->format = GST_GZDEC_FORMAT_GZIP;
+  else if (gst_structure_has_name (s, "application/x-bzip2")
+      || gst_structure_has_name (s, "application/x-bzip"))
+    filter->format = GST_GZDEC_FORMAT_BZIP2;
+  else if (gst_structure_has_name (s, "application/x-zlib"))
+    filter->caps_format = GST_GZDEC_INPUT_FORMAT_ZLIB;
+  else if (gst_structure_has_name (s, "application/x-deflate"))
+    filter->caps_format = GST_GZDEC_INPUT_FORMAT_DEFLATE;
+#ifdef HAVE_ZSTD
+  else if (gst_structure_has_name (s, "application/zstd"))
+    filter->format = GST_GZDEC_FORMAT_ZSTD;
+#endif
+#ifdef HAVE_LZ4
+  else if (gst_structure_has_name (s, "application/x-lz4"))
+    filter->format = GST_GZDEC_FORMAT_LZ4;
+#endif
+  else
+    filter->caps_named = FALSE;
+
+  return filter->caps_named;
+}
+
+static gboolean gst_gzdec_sink_event (GstPad    *pad,
+    GstObject *parent, GstEvent  *event)
+{
+  GstGzdec *filter = GST_GZDEC (parent);
+  gboolean ret;
+
+  if (filter->ring == NULL)
+    return gst_gzdec_handle_event (filter, event);
+
+  // Async mode, serialized events go through the ring with the data
+  switch (GST_EVENT_TYPE (event)) {
+  case GST_EVENT_FLUSH_START:
+    gst_gzdec_ring_set_flow (filter->ring, GST_FLOW_FLUSHING);
+    ret = gst_pad_push_event (filter->srcpad, event);
+    gst_pad_pause_task (filter->srcpad);
+    break;
+  case GST_EVENT_FLUSH_STOP:
+    gst_gzdec_ring_clear (filter->ring);
+    gst_gzdec_ring_set_flow (filter->ring, GST_FLOW_OK);
+    ret = gst_gzdec_handle_event (filter, event);
+    break;
+  default:
+    if (GST_EVENT_IS_SERIALIZED (event))
+      ret = gst_gzdec_async_queue (filter, GST_MINI_OBJECT_CAST (event))
+          == GST_FLOW_OK;
+    else
+      ret = gst_gzdec_handle_event (filter, event);
+    break;
+  }
+  return ret;
+}
+
+static gboolean
+gst_gzdec_handle_event (GstGzdec * filter, GstEvent * event)
+{
+  GstPad *pad = filter->sinkpad;
+  GstObject *parent = GST_OBJECT (filter);
+  gboolean ret;
+
+  /* Input gathered for min-input-bytes goes out ahead of the event. Its
+   * flow is returned for the next buffer, at EOS an error is posted */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    gst_gzdec_flush (filter);
+  } else if (GST_EVENT_IS_SERIALIZED (event) && filter->batch->len > 0) {
+    GstFlowReturn flow = gst_gzdec_batch_flush (filter);
+
+    if (flow != GST_FLOW_OK)
+      filter->batch_flow = flow;
+    if (GST_EVENT_TYPE (event) == GST_EVENT_EOS
+        && (flow == GST_FLOW_NOT_LINKED || flow < GST_FLOW_EOS))
+      GST_ELEMENT_FLOW_ERROR (filter, flow);
+  }
+
+  switch (GST_EVENT_TYPE (event)) {
+  case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      GstStructure *s;
+
+      gst_event_parse_caps (event, &caps);
+      s = gst_caps_get_structure (caps, 0);
+
+      // Compressed caps, the src caps come from typefind if at all
+      ret = gst_gzdec_format_from_caps (filter, s);
+      gst_event_unref (event);
+      break;
+    }
+  case GST_EVENT_STREAM_START:
+    // Unlike after a flush, the format is detected again
+    gst_gzdec_release_decoder (filter);
+    ret = gst_pad_event_default (pad, parent, event);
+    break;
+  case GST_EVENT_SEGMENT:
+    ret = gst_gzdec_push_segment (filter,
+        gst_gzdec_convert_segment (filter, event));
+    break;
+  case GST_EVENT_EOS:
+    gst_gzdec_drain (filter);
+    gst_gzdec_typefind (filter, NULL, TRUE);
+    gst_gzdec_records_drain (filter);
+    gst_gzdec_complete_index (filter);
+    gst_gzdec_release_decoder (filter);
+    if (filter->stats_interval > 0)
+      gst_gzdec_post_stats (filter, TRUE);
+    ret = gst_pad_event_default (pad, parent, event);
+    break;
+  default:
+    ret = gst_pad_event_default (pad, parent, event);
+    break;
+  }
+  return ret;
+}
+/* Decode in pull mode when upstream can serve random access ranges, so
+ * we read PULL_BLOCK_SIZE at a time instead of whatever block size it
+ * would push.
+ */
+static gboolean
+gst_gzdec_sink_activate (GstPad * pad, GstObject * parent)
+{
+  GstQuery *query;
+  gboolean pull_mode;
+
+  query = gst_query_new_scheduling ();
+  if (! gst_pad_peer_query (pad, query)) {
+    gst_query_unref (query);
+    goto activate_push;
+  }
+
+  pull_mode = gst_query_has_scheduling_mode_with_flags (query,
+      GST_PAD_MODE_PULL, GST_SCHEDULING_FLAG_SEEKABLE);
+  gst_query_unref (query);
+
+  if (! pull_mode)
+    goto activate_push;
+
+  GST_DEBUG_OBJECT (pad, "activating pull");
+  return gst_pad_activate_mode (pad, GST_PAD_MODE_PULL, TRUE);
+
+ activate_push:
+  {
+    GST_DEBUG_OBJECT (pad, "activating push");
+    return gst_pad_activate_mode (pad, GST_PAD_MODE_PUSH, TRUE);
+  }
+}
+
+static gboolean
+gst_gzdec_sink_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstGzdec *filter = GST_GZDEC (parent);
+
+  switch (mode) {
+    case GST_PAD_MODE_PUSH:
+      return TRUE;
+    case GST_PAD_MODE_PULL:
+      if (active) {
+        filter->pull_offset  = 0;
+        filter->pull_started = FALSE;
+        filter->need_segment = TRUE;
+        gst_segment_init (&filter->segment, GST_FORMAT_BYTES);
+        return gst_pad_start_task (pad, (GstTaskFunction) gst_gzdec_loop,
+            pad, NULL);
+      }
+      if (! gst_pad_stop_task (pad))
+        return FALSE;
+      g_clear_pointer (&filter->mapping, g_mapped_file_unref);
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/* Nobody upstream sends stream-start, caps or segment in pull mode. Pick
+ * the format from what upstream can produce (a capsfilter, typically)
+ * and announce a byte stream downstream. The segment follows from
+ * gst_gzdec_loop, after a seek it starts at the seek target.
+ */
+static void
+gst_gzdec_pull_start (GstGzdec * filter)
+{
+  GstCaps *caps;
+  gchar *stream_id;
+
+  caps = gst_pad_peer_query_caps (filter->sinkpad, NULL);
+  if (caps != NULL && ! gst_caps_is_any (caps) && ! gst_caps_is_empty (caps)) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    gst_gzdec_format_from_caps (filter, s);
+  }
+  if (caps != NULL)
+    gst_caps_unref (caps);
+
+  stream_id = gst_pad_create_stream_id (filter->srcpad,
+      GST_ELEMENT (filter), NULL);
+  gst_pad_push_event (filter->srcpad, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+
+  if (filter->use_mmap)
+    gst_gzdec_open_mapping (filter);
+
+  filter->pull_started = TRUE;
+}
+
+/* Map the file upstream reads from, found with a URI query, so it is
+ * decoded straight from the page cache: no read () into freshly
+ * allocated buffers and no second copy of the file in memory. Anything
+ * that is not a local file of the size upstream reports keeps pulling.
+ */
+static void
+gst_gzdec_open_mapping (GstGzdec * filter)
+{
+  GstQuery *query;
+  GError *error = NULL;
+  gchar *uri = NULL, *location;
+  gint64 size = -1;
+
+  query = gst_query_new_uri ();
+  if (gst_pad_peer_query (filter->sinkpad, query))
+    gst_query_parse_uri (query, &uri);
+  gst_query_unref (query);
+
+  location = uri != NULL ? g_filename_from_uri (uri, NULL, NULL) : NULL;
+  if (location == NULL) {
+    GST_DEBUG_OBJECT (filter, "upstream is no local file (%s), pulling",
+        GST_STR_NULL (uri));
+    g_free (uri);
+    return;
+  }
+  g_free (uri);
+
+  filter->mapping = g_mapped_file_new (location, FALSE, &error);
+  if (filter->mapping == NULL) {
+    GST_WARNING_OBJECT (filter, "could not map %s, pulling: %s", location,
+        error->message);
+    g_error_free (error);
+    g_free (location);
+    return;
+  }
+
+  if (! gst_pad_peer_query_duration (filter->sinkpad, GST_FORMAT_BYTES,
+          &size)
+      || (guint64) size != g_mapped_file_get_length (filter->mapping)) {
+    GST_DEBUG_OBJECT (filter, "%s is not what upstream reads, pulling",
+        location);
+    g_clear_pointer (&filter->mapping, g_mapped_file_unref);
+    g_free (location);
+    return;
+  }
+
+#ifdef HAVE_POSIX_MADVISE
+  if (size > 0)
+    posix_madvise (g_mapped_file_get_contents (filter->mapping), size,
+        POSIX_MADV_SEQUENTIAL);
+#endif
+
+  GST_DEBUG_OBJECT (filter, "decoding %s from a mapping of %" G_GINT64_FORMAT
+      " bytes", location, size);
+  g_free (location);
+}
+
+/* Like gst_pad_pull_range, from the mapping. The buffer keeps the
+ * mapping alive; the blocks after it are read ahead.
+ */
+static GstFlowReturn
+gst_gzdec_map_range (GstGzdec * filter, guint64 offset, guint size,
+    GstBuffer ** buf)
+{
+  gsize length = g_mapped_file_get_length (filter->mapping);
+  gchar *data = g_mapped_file_get_contents (filter->mapping);
+
+  if (offset >= length)
+    return GST_FLOW_EOS;
+
+  size = MIN (size, length - offset);
+  *buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, data,
+      length, offset, size, g_mapped_file_ref (filter->mapping),
+      (GDestroyNotify) g_mapped_file_unref);
+  GST_BUFFER_OFFSET (*buf) = offset;
+
+#ifdef HAVE_POSIX_MADVISE
+  if (offset + size < length) {
+    // The mapping is page aligned, the hint has to be too
+    gsize page = sysconf (_SC_PAGESIZE);
+    gsize ahead = (offset + size) & ~(page - 1);
+
+    posix_madvise (data + ahead, MIN (MMAP_READAHEAD, length - ahead),
+        POSIX_MADV_WILLNEED);
+  }
+#endif
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_gzdec_loop (GstPad * pad)
+{
+  GstGzdec *filter = GST_GZDEC (GST_PAD_PARENT (pad));
+  GstBuffer *buf = NULL;
+  gboolean upstream_eos = FALSE;
+  GstFlowReturn ret;
+
+  if (G_UNLIKELY (! filter->pull_started))
+    gst_gzdec_pull_start (filter);
+
+  if (G_UNLIKELY (filter->need_segment)) {
+    gst_gzdec_push_segment (filter, gst_event_new_segment (&filter->segment));
+    filter->need_segment = FALSE;
+  }
+
+  if (filter->mapping != NULL)
+    ret = gst_gzdec_map_range (filter, filter->pull_offset, PULL_BLOCK_SIZE,
+        &buf);
+  else
+    ret = gst_pad_pull_range (pad, filter->pull_offset, PULL_BLOCK_SIZE,
+        &buf);
+  if (ret != GST_FLOW_OK) {
+    upstream_eos = ret == GST_FLOW_EOS;
+    goto pause;
+  }
+
+  filter->pull_offset += gst_buffer_get_size (buf);
+
+  ret = gst_gzdec_process (filter, &buf, 1);
+  if (ret != GST_FLOW_OK)
+    goto pause;
+
+  return;
+
+ pause:
+  {
+    GST_DEBUG_OBJECT (filter, "pausing task: %s", gst_flow_get_name (ret));
+    gst_pad_pause_task (pad);
+
+    if (ret == GST_FLOW_EOS) {
+      gst_gzdec_drain (filter);
+      gst_gzdec_typefind (filter, NULL, TRUE);
+      gst_gzdec_records_drain (filter);
+      // Not when a seek segment ended early
+      if (upstream_eos)
+        gst_gzdec_complete_index (filter);
+      gst_gzdec_release_decoder (filter);
+      if (filter->stats_interval > 0)
+        gst_gzdec_post_stats (filter, TRUE);
+      gst_pad_push_event (filter->srcpad, gst_event_new_eos ());
+    } else if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_FLOW_ERROR (filter, ret);
+      gst_pad_push_event (filter->srcpad, gst_event_new_eos ());
+    }
+  }
+}
+
+/* In async mode the ring is set up with the src pad, the task decoding
+ * from it is started by the first buffer or event. Deactivating wakes
+ * both threads, the ring itself goes at PAUSED_TO_READY, once upstream
+ * is out of gst_gzdec_chain.
+ */
+static gboolean
+gst_gzdec_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstGzdec *filter = GST_GZDEC (parent);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  if (active) {
+    GST_OBJECT_LOCK (filter);
+    if (filter->ring != NULL) {
+      gst_gzdec_ring_clear (filter->ring);
+      gst_gzdec_ring_set_flow (filter->ring, GST_FLOW_OK);
+    } else if (filter->async) {
+      filter->ring = gst_gzdec_ring_new (ASYNC_RING_SLOTS,
+          filter->max_level_bytes);
+    }
+    GST_OBJECT_UNLOCK (filter);
+    return TRUE;
+  }
+
+  if (filter->ring == NULL)
+    return TRUE;
+
+  gst_gzdec_ring_set_flow (filter->ring, GST_FLOW_FLUSHING);
+  return gst_pad_stop_task (pad);
+}
+
+/* Async mode: hand a buffer or serialized event to the src pad task.
+ * Blocks while max-level-bytes are queued, and once the task stopped
+ * returns why, so upstream stops as well.
+ */
+static GstFlowReturn
+gst_gzdec_async_queue (GstGzdec * filter, GstMiniObject * item)
+{
+  if (G_UNLIKELY (gst_pad_get_task_state (filter->srcpad)
+          != GST_TASK_STARTED)
+      && gst_gzdec_ring_get_flow (filter->ring) == GST_FLOW_OK)
+    gst_pad_start_task (filter->srcpad,
+        (GstTaskFunction) gst_gzdec_async_loop, filter->srcpad, NULL);
+
+  return gst_gzdec_ring_push (filter->ring, item);
+}
+
+static void
+gst_gzdec_async_loop (GstPad * pad)
+{
+  GstGzdec *filter = GST_GZDEC (GST_PAD_PARENT (pad));
+  GstMiniObject *item;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean eos_pushed = FALSE;
+
+  // Gathered input is not kept waiting past the deadline of its batch
+  if (filter->batch->len > 0)
+    item = gst_gzdec_ring_pop_until (filter->ring, filter->batch_deadline);
+  else
+    item = gst_gzdec_ring_pop (filter->ring);
+  if (item == NULL) {
+    ret = gst_gzdec_ring_get_flow (filter->ring);
+    if (ret == GST_FLOW_OK)
+      ret = gst_gzdec_batch_flush (filter);
+    if (ret != GST_FLOW_OK)
+      goto pause;
+    return;
+  }
+
+  if (GST_IS_BUFFER (item)) {
+    ret = gst_gzdec_batch_add (filter, GST_BUFFER_CAST (item));
+  } else {
+    eos_pushed = GST_EVENT_TYPE (item) == GST_EVENT_EOS;
+    gst_gzdec_handle_event (filter, GST_EVENT_CAST (item));
+    if (eos_pushed)
+      ret = GST_FLOW_EOS;
+  }
+  if (ret != GST_FLOW_OK)
+    goto pause;
+
+  return;
+
+ pause:
+  {
+    GST_DEBUG_OBJECT (filter, "pausing task: %s", gst_flow_get_name (ret));
+    // What gst_gzdec_chain returns until the next flush
+    if (ret != GST_FLOW_FLUSHING)
+      gst_gzdec_ring_set_flow (filter->ring, ret);
+    gst_pad_pause_task (pad);
+
+    // The segment stop was reached, upstream won't get its EOS through
+    if (ret == GST_FLOW_EOS && ! eos_pushed) {
+      gst_gzdec_handle_event (filter, gst_event_new_eos ());
+    } else if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_FLOW_ERROR (filter, ret);
+      gst_pad_push_event (filter->srcpad, gst_event_new_eos ());
+    }
+  }
+}
+
+/* Seeking in decoded bytes, pull mode only. The streaming thread is
+ * stopped, decoding restarts at the last index checkpoint before the
+ * target (or at the start of the file) and gst_gzdec_push drops what
+ * is decoded in front of the target.
+ */
+static gboolean
+gst_gzdec_handle_seek (GstGzdec * filter, GstEvent * event)
+{
+  gdouble rate;
+  GstFormat format;
+  GstSeekFlags flags;
+  GstSeekType start_type, stop_type;
+  gint64 start, stop;
+  gboolean flush;
+
+  gst_event_parse_seek (event, &rate, &format, &flags, &start_type, &start,
+      &stop_type, &stop);
+
+  if (format != GST_FORMAT_BYTES || rate != 1.0
+      || start_type != GST_SEEK_TYPE_SET || start < 0)
+    goto unsupported;
+
+  flush = (flags & GST_SEEK_FLAG_FLUSH) != 0;
+
+  if (flush)
+    gst_pad_push_event (filter->srcpad, gst_event_new_flush_start ());
+  gst_pad_pause_task (filter->sinkpad);
+
+  GST_PAD_STREAM_LOCK (filter->sinkpad);
+
+  if (flush)
+    gst_pad_push_event (filter->srcpad, gst_event_new_flush_stop (TRUE));
+
+  gst_segment_do_seek (&filter->segment, rate, format, flags, start_type,
+      start, stop_type, stop, NULL);
+  filter->need_segment = TRUE;
+
+  gst_gzdec_reposition (filter, start);
+
+  gst_pad_start_task (filter->sinkpad, (GstTaskFunction) gst_gzdec_loop,
+      filter->sinkpad, NULL);
+
+  GST_PAD_STREAM_UNLOCK (filter->sinkpad);
+
+  return TRUE;
+
+ unsupported:
+  {
+    GST_DEBUG_OBJECT (filter, "unsupported seek: format %s rate %f",
+        gst_format_get_name (format), rate);
+    return FALSE;
+  }
+}
+
+static gboolean
+gst_gzdec_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstGzdec *filter = GST_GZDEC (parent);
+  gboolean ret;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEEK:
+      // Upstream offsets are compressed bytes, do not pass seeks on
+      if (GST_PAD_MODE (filter->sinkpad) == GST_PAD_MODE_PULL) {
+        ret = gst_gzdec_handle_seek (filter, event);
+        gst_event_unref (event);
+        break;
+      }
+      ret = gst_pad_event_default (pad, parent, event);
+      break;
+    default:
+      ret = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return ret;
+}
+
+/* Sum of ISIZE over all BGZF blocks, found by reading each block header
+ * together with the trailer of the block before it. -1 if the file turns
+ * out not to be BGZF all the way.
+ */
+static gint64
+gst_gzdec_bgzf_duration (GstGzdec * filter, guint64 in_size)
+{
+  guint64 offset = 0, total = 0;
+  guint8 header[4 + 64];
+
+  while (offset < in_size) {
+    GstBuffer * buf = NULL;
+    guint64 start = offset > 0 ? offset - 4 : 0;
+    gsize size, skip = offset - start;
+    gssize block_size;
+
+    if (gst_pad_pull_range (filter->sinkpad, start, sizeof (header), &buf)
+        != GST_FLOW_OK)
+      return -1;
+    size = gst_buffer_extract (buf, 0, header, sizeof (header));
+    gst_buffer_unref (buf);
+
+    if (size < skip)
+      return -1;
+    if (offset > 0)
+      total += GST_READ_UINT32_LE (header);
+
+    block_size = gst_gzdec_bgzf_block_size (header + skip, size - skip);
+    // Truncated header or an ordinary gzip member
+    if (block_size <= 0)
+      return -1;
+
+    offset += block_size;
+  }
+
+  if (offset != in_size)
+    return -1;
+
+  return total;
+}
+
+/* Decoded size of the stream, -1 if unknown. Known once a full pass or a
+ * loaded index recorded it, and for BGZF in pull mode, where the ISIZE of
+ * every block is read. Other gzip is left unknown until then: the ISIZE
+ * of the last member, what gzip -l reports, misses the members before it
+ * and wraps at 4 GiB.
+ */
+static gint64
+gst_gzdec_get_duration (GstGzdec * filter)
+{
+  gint64 in_size;
+  guint8 header[BGZF_HEADER_SIZE];
+  GstBuffer * buf = NULL;
+  gsize size;
+
+  if (filter->index != NULL && filter->index->total_out > 0)
+    return filter->index->total_out;
+
+  if (filter->duration_probed || filter->duration >= 0
+      || filter->format != GST_GZDEC_FORMAT_GZIP
+      || GST_PAD_MODE (filter->sinkpad) != GST_PAD_MODE_PULL)
+    return filter->duration;
+  filter->duration_probed = TRUE;
+
+  if (! gst_pad_peer_query_duration (filter->sinkpad, GST_FORMAT_BYTES,
+          &in_size) || in_size < 20)
+    return -1;
+
+  if (gst_pad_pull_range (filter->sinkpad, 0, sizeof (header), &buf)
+      != GST_FLOW_OK)
+    return -1;
+  size = gst_buffer_extract (buf, 0, header, sizeof (header));
+  gst_buffer_unref (buf);
+
+  if (size < 2 || header[0] != 0x1f || header[1] != 0x8b)
+    return -1;
+
+  if (gst_gzdec_bgzf_block_size (header, size) > 0)
+    filter->duration = gst_gzdec_bgzf_duration (filter, in_size);
+
+  return filter->duration;
+}
+
+static gboolean
+gst_gzdec_src_convert (GstGzdec * filter, GstFormat src_format,
+    gint64 src_value, GstFormat dest_format, gint64 * dest_value)
+{
+  gint64 duration;
+
+  if (src_format == dest_format || src_value == -1) {
+    *dest_value = src_value;
+    return TRUE;
+  }
+
+  duration = gst_gzdec_get_duration (filter);
+  if (duration <= 0)
+    return FALSE;
+
+  if (src_format == GST_FORMAT_BYTES && dest_format == GST_FORMAT_PERCENT) {
+    *dest_value = gst_util_uint64_scale (src_value, GST_FORMAT_PERCENT_MAX,
+        duration);
+    return TRUE;
+  }
+
+  if (src_format == GST_FORMAT_PERCENT && dest_format == GST_FORMAT_BYTES) {
+    *dest_value = gst_util_uint64_scale (src_value, duration,
+        GST_FORMAT_PERCENT_MAX);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Positions and sizes are in decoded bytes: upstream only knows the
+ * compressed ones, so BYTES queries are never passed on.
+ */
+static gboolean
+gst_gzdec_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  GstGzdec *filter = GST_GZDEC (parent);
+  gboolean ret;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    {
+      GstCaps *filt, *caps;
+
+      // With typefind anything can come out, not just what upstream
+      // produces
+      if (! filter->typefind) {
+        ret = gst_pad_query_default (pad, parent, query);
+        break;
+      }
+
+      gst_query_parse_caps (query, &filt);
+      caps = gst_pad_get_current_caps (pad);
+      if (caps == NULL)
+        caps = gst_pad_get_pad_template_caps (pad);
+      if (filt != NULL) {
+        GstCaps *tmp = gst_caps_intersect_full (filt, caps,
+            GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref (caps);
+        caps = tmp;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      ret = TRUE;
+      break;
+    }
+    case GST_QUERY_SEEKING:
+    {
+      GstFormat format;
+
+      if (GST_PAD_MODE (filter->sinkpad) != GST_PAD_MODE_PULL) {
+        ret = gst_pad_query_default (pad, parent, query);
+        break;
+      }
+
+      gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
+      gst_query_set_seeking (query, format, format == GST_FORMAT_BYTES,
+          0, format == GST_FORMAT_BYTES ? gst_gzdec_get_duration (filter)
+          : -1);
+      ret = TRUE;
+      break;
+    }
+    case GST_QUERY_DURATION:
+    {
+      GstFormat format;
+      gint64 duration;
+
+      gst_query_parse_duration (query, &format, NULL);
+      if (format != GST_FORMAT_BYTES) {
+        ret = gst_pad_query_default (pad, parent, query);
+        break;
+      }
+
+      duration = gst_gzdec_get_duration (filter);
+      if (duration < 0) {
+        ret = FALSE;
+        break;
+      }
+
+      gst_query_set_duration (query, GST_FORMAT_BYTES, duration);
+      ret = TRUE;
+      break;
+    }
+    case GST_QUERY_POSITION:
+    {
+      GstFormat format;
+      gint64 position;
+
+      gst_query_parse_position (query, &format, NULL);
+      position = MAX (filter->pushed_out, filter->segment.start);
+      ret = gst_gzdec_src_convert (filter, GST_FORMAT_BYTES, position,
+          format, &position);
+      if (ret)
+        gst_query_set_position (query, format, position);
+      break;
+    }
+    case GST_QUERY_LATENCY:
+    {
+      gboolean live;
+      GstClockTime min, max;
+
+      ret = gst_pad_query_default (pad, parent, query);
+      if (! ret || filter->min_input_bytes == 0)
+        break;
+
+      // Gathered input waits up to max-input-latency
+      gst_query_parse_latency (query, &live, &min, &max);
+      min += filter->max_input_latency;
+      if (GST_CLOCK_TIME_IS_VALID (max))
+        max += filter->max_input_latency;
+      gst_query_set_latency (query, live, min, max);
+      break;
+    }
+    case GST_QUERY_CONVERT:
+    {
+      GstFormat src_format, dest_format;
+      gint64 src_value, dest_value;
+
+      gst_query_parse_convert (query, &src_format, &src_value,
+          &dest_format, NULL);
+      ret = gst_gzdec_src_convert (filter, src_format, src_value,
+          dest_format, &dest_value);
+      if (ret)
+        gst_query_set_convert (query, src_format, src_value, dest_format,
+            dest_value);
+      break;
+    }
+    default:
+      ret = gst_pad_query_default (pad, parent, query);
+      break;
+  }
+
+  return ret;
+}
+
+/* Private methods implementation */
+
+/* Run the ALLOCATION query on the src pad and remember what downstream
+ * proposed. The allocator and its parameters are used for every output
+ * chunk; with use-buffer-pool the proposed pool (or an internal one) is
+ * configured for output-chunk-size buffers and activated.
+ */
+static void
+gst_gzdec_decide_allocation (GstGzdec * filter)
+{
+  GstCaps * caps;
+  GstQuery * query;
+  GstStructure * config;
+  GstBufferPool * pool = NULL;
+  GstAllocator * allocator = NULL;
+  GstAllocationParams params;
+  guint size = 0, min = 0, max = 0;
+
+  gst_gzdec_clear_allocation (filter);
+  filter->allocation_decided = TRUE;
+
+  caps  = gst_pad_get_current_caps (filter->srcpad);
+  query = gst_query_new_allocation (caps, filter->use_buffer_pool);
+  gst_allocation_params_init (&params);
+
+  if (! gst_pad_peer_query (filter->srcpad, query))
+    GST_DEBUG_OBJECT (filter, "peer ALLOCATION query failed");
+
+  if (gst_query_get_n_allocation_params (query) > 0)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+
+  if (filter->use_buffer_pool) {
+    if (gst_query_get_n_allocation_pools (query) > 0)
+      gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+
+    if (pool == NULL) {
+      GST_DEBUG_OBJECT (filter, "no downstream pool, using internal one");
+      pool = gst_buffer_pool_new ();
+    }
+
+    size = MAX (size, filter->output_chunk_size);
+    if (filter->max_output_buffer_size > 0)
+      size = MIN (size, filter->max_output_buffer_size);
+
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, min, max);
+    gst_buffer_pool_config_set_allocator (config, allocator, &params);
+
+    if (! gst_buffer_pool_set_config (pool, config)) {
+      // The pool may have adjusted the config, accept it if still usable
+      config = gst_buffer_pool_get_config (pool);
+      if (! gst_buffer_pool_config_validate_params (config, caps, size,
+              min, max) || ! gst_buffer_pool_set_config (pool, config)) {
+        GST_WARNING_OBJECT (filter, "could not configure buffer pool");
+        gst_clear_object (&pool);
+      }
+    }
+
+    if (pool != NULL && ! gst_buffer_pool_set_active (pool, TRUE)) {
+      GST_WARNING_OBJECT (filter, "could not activate buffer pool");
+      gst_clear_object (&pool);
+    }
+  }
+
+  filter->allocator = allocator;
+  filter->params    = params;
+  filter->pool      = pool;
+
+  gst_query_unref (query);
+  if (caps != NULL)
+    gst_caps_unref (caps);
+}
+
+static void
+gst_gzdec_clear_allocation (GstGzdec * filter)
+{
+  if (filter->pool != NULL) {
+    gst_buffer_pool_set_active (filter->pool, FALSE);
+    gst_clear_object (&filter->pool);
+  }
+
+  gst_clear_object (&filter->allocator);
+  gst_allocation_params_init (&filter->params);
+  filter->allocation_decided = FALSE;
+}
+
+/* Expected decoded size of avail_in compressed bytes, based on the
+ * expansion ratio observed so far in the stream.
+ */
+static guint64
+gst_gzdec_output_estimate (GstGzdec * filter, gsize avail_in)
+{
+  if (filter->bytes_in > 0)
+    return gst_util_uint64_scale (avail_in, filter->bytes_out,
+        filter->bytes_in);
+
+  return (guint64) avail_in * DEFAULT_RATIO_ESTIMATE;
+}
+
+/* Size of the next output chunk. In adaptive mode the estimate is
+ * applied to the pending input, so that a single decompression step
+ * can usually fill the whole chunk.
+ */
+static gsize
+gst_gzdec_chunk_size (GstGzdec * filter, gsize avail_in)
+{
+  guint64 size = filter->output_chunk_size;
+
+  if (filter->adaptive_chunk_size)
+    size = CLAMP (gst_gzdec_output_estimate (filter, avail_in),
+        filter->output_chunk_size, MAX_OUT_BUF_SIZE);
+
+  if (filter->max_output_buffer_size > 0)
+    size = MIN (size, filter->max_output_buffer_size);
+
+  return size;
+}
+
+/* Output assembly.
+ *
+ * Encoders ask for writable space with gst_gzdec_output_reserve, report
+ * how much of it was filled with gst_gzdec_output_commit and hand the
+ * result over to the output buffer with gst_gzdec_output_finish.
+ *
+ * In chunked mode every step writes into a freshly allocated memory block
+ * which is appended to the output buffer. In contiguous mode all steps
+ * write into one block, preallocated from the ratio estimate and grown
+ * geometrically with g_realloc, so the pushed buffer holds exactly one
+ * memory and nobody has to merge it later. In pool mode steps write into
+ * a buffer acquired from the negotiated pool, which is pushed as soon as
+ * it is full; the last, partially filled one becomes the output buffer.
+ *
+ * With max-output-buffer-size set, pending output is pushed once it
+ * reaches the limit, so the memory held for a single input buffer stays
+ * bounded no matter how well it compresses. In low-latency mode it is
+ * pushed after every step that produced something.
+ */
+static GstFlowReturn
+gst_gzdec_output_reserve (GstGzdec * filter, gsize avail_in,
+    guint8 ** data, gsize * size)
+{
+  GstFlowReturn ret;
+
+  if (filter->pool != NULL) {
+    if (filter->out_pooled == NULL) {
+      ret = gst_buffer_pool_acquire_buffer (filter->pool, &filter->out_pooled,
+          NULL);
+      if (ret != GST_FLOW_OK)
+        return ret;
+      filter->stats_chunks++;
+
+      if (! gst_buffer_map (filter->out_pooled, &filter->out_map,
+              GST_MAP_WRITE)) {
+        gst_clear_buffer (&filter->out_pooled);
+        return GST_FLOW_ERROR;
+      }
+
+      filter->out_size = 0;
+    }
+
+    *data = filter->out_map.data + filter->out_size;
+    *size = MIN (filter->out_map.size - filter->out_size, G_MAXUINT);
+    return GST_FLOW_OK;
+  }
+
+  if (filter->contiguous_output) {
+    gsize min_free = filter->output_chunk_size;
+
+    if (filter->out_alloc - filter->out_size < min_free) {
+      guint64 wanted = filter->out_size
+          + MAX (gst_gzdec_output_estimate (filter, avail_in), min_free);
+
+      wanted = MAX (wanted, (guint64) filter->out_alloc * 2);
+      if (filter->max_output_buffer_size > 0)
+        wanted = MIN (wanted, MAX (filter->max_output_buffer_size,
+                filter->out_size + min_free));
+      wanted = MIN (wanted, G_MAXUINT);
+      if (wanted - filter->out_size < min_free)
+        return GST_FLOW_ERROR;
+
+      if (filter->out_data == NULL)
+        filter->stats_chunks++;
+      filter->out_data  = g_realloc (filter->out_data, wanted);
+      filter->out_alloc = wanted;
+    }
+
+    *data = filter->out_data + filter->out_size;
+    *size = MIN (filter->out_alloc - filter->out_size, G_MAXUINT);
+    return GST_FLOW_OK;
+  }
+
+  filter->out_memory = gst_allocator_alloc (filter->allocator,
+      gst_gzdec_chunk_size (filter, avail_in), &filter->params);
+  if (filter->out_memory == NULL)
+    return GST_FLOW_ERROR;
+  filter->stats_chunks++;
+
+  if (! gst_memory_map (filter->out_memory, &filter->out_map,
+          GST_MAP_WRITE)) {
+    gst_memory_unref (filter->out_memory);
+    filter->out_memory = NULL;
+    return GST_FLOW_ERROR;
+  }
+
+  *data = filter->out_map.data;
+  *size = filter->out_map.size;
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_gzdec_output_commit (GstGzdec * filter, GstBuffer ** outbuf,
+    gsize produced)
+{
+  gsize pending;
+
+  if (filter->pool != NULL) {
+    filter->out_size += produced;
+    if (filter->out_size == filter->out_map.size
+        || (filter->low_latency && filter->out_size > 0))
+      return gst_gzdec_output_push (filter, outbuf);
+
+    return GST_FLOW_OK;
+  }
+
+  if (filter->contiguous_output) {
+    filter->out_size += produced;
+    pending = filter->out_size;
+  } else {
+    gst_memory_unmap (filter->out_memory, &filter->out_map);
+
+    if (produced > 0) {
+      gst_memory_resize (filter->out_memory, 0, produced);
+      gst_buffer_append_memory (*outbuf, filter->out_memory);
+    } else {
+      gst_memory_unref (filter->out_memory);
+    }
+
+    filter->out_memory = NULL;
+    pending = gst_buffer_get_size (*outbuf);
+  }
+
+  return gst_gzdec_output_check (filter, outbuf, pending);
+}
+
+// Push pending output if low-latency or max-output-buffer-size ask for it
+static GstFlowReturn
+gst_gzdec_output_check (GstGzdec * filter, GstBuffer ** outbuf,
+    gsize pending)
+{
+  if (filter->low_latency && pending > 0)
+    return gst_gzdec_output_push (filter, outbuf);
+
+  if (filter->max_output_buffer_size > 0
+      && pending >= filter->max_output_buffer_size)
+    return gst_gzdec_output_push (filter, outbuf);
+
+  return GST_FLOW_OK;
+}
+
+/* Push everything decoded so far and start a new output buffer. Only the
+ * first buffer decoded from an input buffer carries its timestamps.
+ */
+static GstFlowReturn
+gst_gzdec_output_push (GstGzdec * filter, GstBuffer ** outbuf)
+{
+  GstBuffer * full;
+
+  gst_gzdec_output_finish (filter, outbuf);
+  full = *outbuf;
+
+  *outbuf = gst_buffer_new ();
+
+  if (gst_buffer_get_size (full) == 0) {
+    gst_buffer_unref (full);
+    return GST_FLOW_OK;
+  }
+
+  return gst_gzdec_push (filter, full);
+}
+
+/* Timestamps and the discontinuity of the input, not all of its
+ * metadata: the flags and metas of compressed data say nothing about the
+ * decoded bytes, and copying them for every buffer is not free.
+ */
+static void
+gst_gzdec_copy_timestamps (GstBuffer * dest, GstBuffer * src)
+{
+  GST_BUFFER_PTS (dest)      = GST_BUFFER_PTS (src);
+  GST_BUFFER_DTS (dest)      = GST_BUFFER_DTS (src);
+  GST_BUFFER_DURATION (dest) = GST_BUFFER_DURATION (src);
+  if (GST_BUFFER_IS_DISCONT (src))
+    GST_BUFFER_FLAG_SET (dest, GST_BUFFER_FLAG_DISCONT);
+}
+
+static void
+gst_gzdec_output_finish (GstGzdec * filter, GstBuffer ** outbuf)
+{
+  if (filter->out_pooled != NULL) {
+    GstBuffer * pooled = filter->out_pooled;
+    gsize size = filter->out_size;
+
+    filter->out_pooled = NULL;
+    filter->out_size   = 0;
+    gst_buffer_unmap (pooled, &filter->out_map);
+
+    if (size == 0) {
+      gst_buffer_unref (pooled);
+      return;
+    }
+
+    gst_buffer_set_size (pooled, size);
+    gst_gzdec_copy_timestamps (pooled, *outbuf);
+
+    gst_buffer_unref (*outbuf);
+    *outbuf = pooled;
+    return;
+  }
+
+  if (filter->out_data == NULL)
+    return;
+
+  if (filter->out_size == 0) {
+    gst_gzdec_output_discard (filter);
+    return;
+  }
+
+  // Give back the slack if the estimate was far off
+  if (filter->out_alloc - filter->out_size > filter->out_size / 4) {
+    filter->out_data  = g_realloc (filter->out_data, filter->out_size);
+    filter->out_alloc = filter->out_size;
+  }
+
+  gst_buffer_append_memory (*outbuf,
+      gst_memory_new_wrapped (0, filter->out_data, filter->out_alloc,
+          0, filter->out_size, filter->out_data, g_free));
+
+  filter->out_data  = NULL;
+  filter->out_size  = 0;
+  filter->out_alloc = 0;
+}
+
+static void
+gst_gzdec_output_discard (GstGzdec * filter)
+{
+  if (filter->out_pooled != NULL) {
+    gst_buffer_unmap (filter->out_pooled, &filter->out_map);
+    gst_clear_buffer (&filter->out_pooled);
+  }
+
+  if (filter->out_memory != NULL) {
+    gst_memory_unmap (filter->out_memory, &filter->out_map);
+    gst_memory_unref (filter->out_memory);
+    filter->out_memory = NULL;
+  }
+
+  g_free (filter->out_data);
+  filter->out_data  = NULL;
+  filter->out_size  = 0;
+  filter->out_alloc = 0;
+}
+
+/* Add a memory decoded elsewhere, e.g. by a worker thread, to the output.
+ * In chunked mode it is appended as is; pool buffers and the contiguous
+ * block get a copy.
+ */
+static GstFlowReturn
+gst_gzdec_output_append (GstGzdec * filter, GstBuffer ** outbuf,
+    GstMemory * mem)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstMapInfo map;
+  gsize pos;
+
+  if (filter->pool == NULL && ! filter->contiguous_output) {
+    filter->stats_chunks++;
+    filter->bytes_out += gst_memory_get_sizes (mem, NULL, NULL);
+    gst_buffer_append_memory (*outbuf, mem);
+    return gst_gzdec_output_check (filter, outbuf,
+        gst_buffer_get_size (*outbuf));
+  }
+
+  if (! gst_memory_map (mem, &map, GST_MAP_READ)) {
+    gst_memory_unref (mem);
+    return GST_FLOW_ERROR;
+  }
+
+  for (pos = 0; pos < map.size && ret == GST_FLOW_OK; ) {
+    guint8 * data;
+    gsize size;
+
+    ret = gst_gzdec_output_reserve (filter, 0, &data, &size);
+    if (ret != GST_FLOW_OK)
+      break;
+
+    size = MIN (size, map.size - pos);
+    memcpy (data, map.data + pos, size);
+    pos += size;
+
+    filter->bytes_out += size;
+    ret = gst_gzdec_output_commit (filter, outbuf, size);
+  }
+
+  gst_memory_unmap (mem, &map);
+  gst_memory_unref (mem);
+  return ret;
+}
+
+/* The 48 bit block or end of stream magic can also turn up inside the
+ * data of a block, which then ends up split over two jobs that both
+ * fail. Like pbzip2, join a failed block job with the next candidate and
+ * decode the two as one block with libbz2 on the streaming thread, again
+ * with the next candidate as long as that fails. Gives up, leaving the failed job for
+ * the caller to report, when the next job is not a block of the same
+ * stream or the joined block is larger than one of its level can be.
+ * Returns the job to emit, or NULL while the failed one waits for the
+ * next candidate.
+ */
+static GstGzdecJob *
+bzlib_retry_block (GstGzdec * filter, GstGzdecJob * job)
+{
+  GstGzdecJob * failed = filter->par_failed;
+  GstGzdecJob * joined;
+
+  if (failed == NULL) {
+    GST_DEBUG_OBJECT (filter, "bzip2 block at bit %" G_GUINT64_FORMAT
+        " failed, joining it with the next one", job->start_bit);
+    filter->par_failed = job;
+    return NULL;
+  }
+
+  filter->par_failed = NULL;
+  if (job->func != gst_gzdec_job_bunzip2 || job->member_in >= 0
+      || failed->n_bits + job->n_bits > BZIP2_MAX_BLOCK_BITS (failed->level)) {
+    gst_gzdec_job_free (job);
+    return failed;
+  }
+
+  joined = gst_gzdec_job_join_bzip2_blocks (failed, job);
+  // The boundary between them was a false match
+  if (filter->index != NULL)
+    gst_gzdec_index_remove_boundary (filter->index, job->start_bit);
+  gst_gzdec_job_free (failed);
+  gst_gzdec_job_free (job);
+
+  joined->failed = ! gst_gzdec_job_bunzip2 (joined);
+  joined->done   = TRUE;
+  if (joined->failed)
+    return bzlib_retry_block (filter, joined);
+
+  GST_DEBUG_OBJECT (filter, "decoded %" G_GUINT64_FORMAT " bits at bit %"
+      G_GUINT64_FORMAT " as one bzip2 block", joined->n_bits,
+      joined->start_bit);
+  return joined;
+}
+
+/* Output decoded jobs in stream order: everything that is done already,
+ * or with wait set, everything submitted so far. Also waits while the
+ * pool is full, which bounds the decoded data held for reordering.
+ */
+static GstFlowReturn
+gst_gzdec_parallel_flush (GstGzdec * filter, GstBuffer ** outbuf,
+    gboolean wait)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstGzdecJob * job;
+
+  while ((job = gst_gzdec_parallel_pop (filter->parallel,
+              wait || gst_gzdec_parallel_is_full (filter->parallel)))) {
+    GstMemory * mem;
+    gboolean failed;
+
+    if (filter->par_failed != NULL
+        || (job->failed && job->func == gst_gzdec_job_bunzip2)) {
+      job = bzlib_retry_block (filter, job);
+      if (job == NULL)
+        continue;
+    }
+
+    if (job->stream_end) {
+      failed = filter->verify != GST_GZDEC_VERIFY_OFF
+          && job->crc != filter->par_crc;
+      filter->par_crc = 0;
+      gst_gzdec_job_free (job);
+
+      if (failed) {
+        GST_WARNING_OBJECT (filter, "could not decompress stream: bzip2 "
+            "stream CRC mismatch");
+        return GST_FLOW_ERROR;
+      }
+      continue;
+    }
+
+    mem = job->output;
+    failed = job->failed;
+
+    if (! failed && job->member_in >= 0)
+      gst_gzdec_mark_member (filter, job->member, job->member_in,
+          filter->bytes_out);
+    // Only the blocks that decoded count towards the stream CRC
+    if (! failed && job->func == gst_gzdec_job_bunzip2)
+      filter->par_crc = (filter->par_crc << 1 | filter->par_crc >> 31)
+          ^ job->crc;
+
+    job->output = NULL;
+    gst_gzdec_job_free (job);
+
+    if (failed) {
+      if (mem != NULL)
+        gst_memory_unref (mem);
+      GST_WARNING_OBJECT (filter, "could not decompress stream in worker");
+      return GST_FLOW_ERROR;
+    }
+
+    if (gst_memory_get_sizes (mem, NULL, NULL) == 0) {
+      gst_memory_unref (mem);
+      continue;
+    }
+
+    ret = gst_gzdec_output_append (filter, outbuf, mem);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_gzdec_stop_parallel (GstGzdec * filter)
+{
+  g_clear_pointer (&filter->parallel, gst_gzdec_parallel_free);
+  g_clear_pointer (&filter->par_pending, g_byte_array_unref);
+  filter->par_probed = FALSE;
+  filter->par_bit    = 0;
+  filter->par_scan   = 0;
+  filter->par_level  = 0;
+  filter->par_crc    = 0;
+  g_clear_pointer (&filter->par_failed, gst_gzdec_job_free);
+  filter->par_member_in = -1;
+}
+
+/* Hand the decoder context back once the stream is over, the next buffer
+ * starts a new stream with a freshly checked out one.
+ */
+static void
+gst_gzdec_release_decoder (GstGzdec * filter)
+{
+  if (filter->in_progress) {
+    filter->free_encoder (filter);
+    filter->in_progress = FALSE;
+  }
+  gst_gzdec_stop_parallel (filter);
+}
+
+/* Remember the input after the first consumed bytes for the next buffer.
+ * data is either the input buffer or the start of par_pending.
+ */
+static void
+gst_gzdec_parallel_keep (GstGzdec * filter, const guint8 * data,
+    gsize size, gsize consumed)
+{
+  if (data == filter->par_pending->data)
+    g_byte_array_remove_range (filter->par_pending, 0, consumed);
+  else
+    g_byte_array_append (filter->par_pending, data + consumed,
+        size - consumed);
+}
+
+/* At the end of the stream push what the workers still hold, and decode
+ * input that was too short to even decide on parallel decoding.
+ */
+static void
+gst_gzdec_drain (GstGzdec * filter)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer * outbuf;
+
+  // A stream shorter than what format detection waits for
+  if (filter->detect_buf != NULL) {
+    GstBuffer * held = g_steal_pointer (&filter->detect_buf);
+
+    filter->draining = TRUE;
+    ret = gst_gzdec_process (filter, &held, 1);
+    filter->draining = FALSE;
+    if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_FLOW_ERROR (filter, ret);
+      return;
+    }
+  }
+
+  if (filter->par_pending == NULL)
+    return;
+
+  outbuf = gst_buffer_new ();
+
+  if (filter->parallel != NULL) {
+    ret = gst_gzdec_parallel_flush (filter, &outbuf, TRUE);
+    // Nothing left to join the failed block with
+    if (ret == GST_FLOW_OK && filter->par_failed != NULL) {
+      g_clear_pointer (&filter->par_failed, gst_gzdec_job_free);
+      GST_WARNING_OBJECT (filter, "could not decompress stream: corrupt "
+          "bzip2 block at the end of the stream");
+      ret = GST_FLOW_ERROR;
+    }
+    if (filter->par_pending->len > 0 || filter->par_level != 0)
+      GST_WARNING_OBJECT (filter, "dropping %u bytes of truncated input",
+          filter->par_pending->len);
+  } else if (filter->par_pending->len > 0) {
+    ret = filter->decode (filter, filter->par_pending->data,
+        filter->par_pending->len, &outbuf);
+  }
+  g_byte_array_set_size (filter->par_pending, 0);
+
+  if (ret == GST_FLOW_OK)
+    gst_gzdec_output_finish (filter, &outbuf);
+  else
+    gst_gzdec_output_discard (filter);
+
+  if (ret == GST_FLOW_OK && gst_buffer_get_size (outbuf) > 0)
+    gst_gzdec_push (filter, outbuf);
+  else
+    gst_buffer_unref (outbuf);
+}
+
+/* Remember where a member starts, for the GstGzdecMeta of the buffers
+ * pushed from there on. Parallel decoding marks members once their
+ * output is collected, so the marks are always in stream order.
+ */
+static void
+gst_gzdec_mark_member (GstGzdec * filter, guint member, guint64 in,
+    guint64 out)
+{
+  GstGzdecMark mark;
+  GArray * marks = filter->marks;
+
+  if (! filter->member_meta)
+    return;
+
+  mark.member = filter->members_counted
+      ? member : GST_GZDEC_META_MEMBER_UNKNOWN;
+  mark.in     = in;
+  mark.out    = out;
+
+  // A member without output, the data there comes from this one
+  if (marks->len > 0
+      && g_array_index (marks, GstGzdecMark, marks->len - 1).out == out)
+    g_array_index (marks, GstGzdecMark, marks->len - 1) = mark;
+  else
+    g_array_append_val (marks, mark);
+}
+
+/* Attach the member start decoded offset lies in. Marks before that
+ * member are not needed anymore, output only moves forward.
+ */
+static void
+gst_gzdec_add_member_meta (GstGzdec * filter, GstBuffer * buf,
+    guint64 start)
+{
+  GArray * marks = filter->marks;
+  GstGzdecMark * mark;
+  guint i = 0;
+
+  while (i + 1 < marks->len
+      && g_array_index (marks, GstGzdecMark, i + 1).out <= start)
+    i++;
+  if (i > 0)
+    g_array_remove_range (marks, 0, i);
+
+  // Resumed inside a member, nothing known until the next one
+  if (marks->len == 0)
+    return;
+  mark = &g_array_index (marks, GstGzdecMark, 0);
+  if (mark->out > start)
+    return;
+
+  gst_buffer_add_gzdec_meta (buf, mark->member, mark->in,
+      start - mark->out);
+}
+
+/* Push decoded data downstream, clipped to the current segment. After a
+ * seek decoding restarts in front of the target, the bytes up to it are
+ * dropped here, and EOS is returned once the segment stop is reached.
+ */
+static GstFlowReturn
+gst_gzdec_push (GstGzdec * filter, GstBuffer * buf)
+{
+  guint64 start = filter->pushed_out;
+  guint64 end   = start + gst_buffer_get_size (buf);
+  guint64 clip_start, clip_end;
+
+  filter->pushed_out = end;
+
+  clip_start = MAX (start, filter->segment.start);
+  clip_end   = end;
+  if (filter->segment.stop != (guint64) -1)
+    clip_end = MIN (end, filter->segment.stop);
+
+  if (clip_start >= clip_end) {
+    gst_buffer_unref (buf);
+    if (filter->segment.stop != (guint64) -1
+        && start >= filter->segment.stop)
+      return GST_FLOW_EOS;
+    return GST_FLOW_OK;
+  }
+
+  buf = gst_buffer_make_writable (buf);
+  if (clip_start != start || clip_end != end)
+    gst_buffer_resize (buf, clip_start - start, clip_end - clip_start);
+  // Decoded bytes, the same for every backend
+  GST_BUFFER_OFFSET (buf)     = clip_start;
+  GST_BUFFER_OFFSET_END (buf) = clip_end;
+
+  if (filter->member_meta)
+    gst_gzdec_add_member_meta (filter, buf, clip_start);
+
+  if (G_UNLIKELY (filter->typefind && ! filter->typefind_done))
+    return gst_gzdec_typefind (filter, buf, FALSE);
+
+  return gst_gzdec_push_buffer (filter, buf);
+}
+
+static GstFlowReturn
+gst_gzdec_push_buffer (GstGzdec * filter, GstBuffer * buf)
+{
+  if (G_UNLIKELY (filter->records_per_buffer > 0 || filter->record_meta
+          || filter->record_pending != NULL))
+    return gst_gzdec_push_records (filter, buf);
+
+  return gst_gzdec_pad_push (filter, buf);
+}
+
+/* [start, end) of buf as a buffer of its own, sharing the memory. ends
+ * are the records in it relative to buf, NULL for a piece that is held
+ * back and gets no meta yet.
+ */
+static GstBuffer *
+gst_gzdec_record_piece (GstGzdec * filter, GstBuffer * buf, gsize start,
+    gsize end, const gsize * ends, guint n_ends)
+{
+  GstBuffer *piece;
+
+  piece = gst_buffer_copy_region (buf,
+      GST_BUFFER_COPY_METADATA | GST_BUFFER_COPY_MEMORY, start, end - start);
+  GST_BUFFER_OFFSET (piece)     = GST_BUFFER_OFFSET (buf) + start;
+  GST_BUFFER_OFFSET_END (piece) = GST_BUFFER_OFFSET (buf) + end;
+  if (start > 0)
+    GST_BUFFER_FLAG_UNSET (piece, GST_BUFFER_FLAG_DISCONT);
+
+  if (filter->record_meta && ends != NULL) {
+    GstGzdecRecordMeta *meta;
+    guint i;
+
+    meta = gst_buffer_add_gzdec_record_meta (piece, ends, n_ends);
+    for (i = 0; i < n_ends; i++)
+      meta->ends[i] -= start;
+  }
+
+  return piece;
+}
+
+/* Find the newline terminated records in buf and, with
+ * records-per-buffer, push them that many at a time. What follows the
+ * last cut waits in record_pending for more output; only the data
+ * appended to it is scanned again. Pending data is bounded by
+ * max-output-buffer-size, or RECORDS_MAX_PENDING without it, and goes
+ * out with fewer records (or part of one) when it reaches the bound.
+ */
+static GstFlowReturn
+gst_gzdec_push_records (GstGzdec * filter, GstBuffer * buf)
+{
+  GArray *ends = filter->record_ends;
+  guint n = filter->records_per_buffer;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize size, scanned = 0, cut = 0, max_pending;
+  guint first = 0, i;
+
+  max_pending = filter->max_output_buffer_size > 0
+      ? filter->max_output_buffer_size : RECORDS_MAX_PENDING;
+
+  if (filter->record_pending != NULL) {
+    scanned = gst_buffer_get_size (filter->record_pending);
+    buf = gst_buffer_append (g_steal_pointer (&filter->record_pending), buf);
+  }
+  size = gst_buffer_get_size (buf);
+
+  gst_gzdec_find_records (buf, scanned, ends);
+  GST_LOG_OBJECT (filter, "%u records ending in %" G_GSIZE_FORMAT
+      " bytes (%s)", ends->len, size, gst_gzdec_find_records_impl ());
+
+  while (n > 0 && ends->len - first >= n && ret == GST_FLOW_OK) {
+    gsize end = g_array_index (ends, gsize, first + n - 1);
+
+    ret = gst_gzdec_pad_push (filter, gst_gzdec_record_piece (filter, buf,
+            cut, end, &g_array_index (ends, gsize, first), n));
+    cut    = end;
+    first += n;
+  }
+
+  if (ret == GST_FLOW_OK && cut < size) {
+    if (n == 0 || size - cut >= max_pending) {
+      // Only the meta, or too much without enough records: all goes now
+      ret = gst_gzdec_pad_push (filter, gst_gzdec_record_piece (filter, buf,
+              cut, size, &g_array_index (ends, gsize, first),
+              ends->len - first));
+    } else if (cut == 0) {
+      filter->record_pending = buf;
+      return ret;
+    } else {
+      filter->record_pending =
+          gst_gzdec_record_piece (filter, buf, cut, size, NULL, 0);
+      g_array_remove_range (ends, 0, first);
+      for (i = 0; i < ends->len; i++)
+        g_array_index (ends, gsize, i) -= cut;
+      gst_buffer_unref (buf);
+      return ret;
+    }
+  }
+
+  gst_buffer_unref (buf);
+  g_array_set_size (ends, 0);
+
+  return ret;
+}
+
+// At EOS the records left go out however few there are
+static void
+gst_gzdec_records_drain (GstGzdec * filter)
+{
+  GstBuffer *buf = g_steal_pointer (&filter->record_pending);
+  GArray *ends = filter->record_ends;
+
+  if (buf == NULL)
+    return;
+
+  gst_gzdec_pad_push (filter, gst_gzdec_record_piece (filter, buf, 0,
+          gst_buffer_get_size (buf), (const gsize *) ends->data, ends->len));
+  gst_buffer_unref (buf);
+  g_array_set_size (ends, 0);
+}
+
+static void
+gst_gzdec_records_clear (GstGzdec * filter)
+{
+  gst_clear_buffer (&filter->record_pending);
+  g_array_set_size (filter->record_ends, 0);
+}
+
+static GstFlowReturn
+gst_gzdec_pad_push (GstGzdec * filter, GstBuffer * buf)
+{
+  GstClockTime start_time;
+  GstFlowReturn ret;
+
+  start_time = gst_util_get_timestamp ();
+  ret = gst_pad_push (filter->srcpad, buf);
+
+  GST_OBJECT_LOCK (filter);
+  filter->stats_push_time += gst_util_get_timestamp () - start_time;
+  GST_OBJECT_UNLOCK (filter);
+
+  return ret;
+}
+
+/* Upstream sends its segment in compressed bytes. Output goes out in
+ * decoded bytes from where the stream is now, which is also what
+ * gst_gzdec_push clips to; a segment in any other format, time from a
+ * demuxer or a live source, fits the input timestamps the output keeps
+ * and is passed on.
+ */
+static GstEvent *
+gst_gzdec_convert_segment (GstGzdec * filter, GstEvent * event)
+{
+  const GstSegment *segment;
+  GstEvent *converted;
+
+  gst_event_parse_segment (event, &segment);
+  if (segment->format != GST_FORMAT_BYTES)
+    return event;
+
+  gst_segment_init (&filter->segment, GST_FORMAT_BYTES);
+  filter->segment.flags        = segment->flags;
+  filter->segment.rate         = segment->rate;
+  filter->segment.applied_rate = segment->applied_rate;
+  filter->segment.base         = segment->base;
+  filter->segment.start    = filter->in_progress ? filter->pushed_out : 0;
+  filter->segment.time     = filter->segment.start;
+  filter->segment.position = filter->segment.start;
+
+  converted = gst_event_new_segment (&filter->segment);
+  gst_event_set_seqnum (converted, gst_event_get_seqnum (event));
+  gst_event_unref (event);
+
+  return converted;
+}
+
+/* Caps have to go out before the segment, so while the output is being
+ * typefound the segment waits in typefind_segment.
+ */
+static gboolean
+gst_gzdec_push_segment (GstGzdec * filter, GstEvent * event)
+{
+  if (filter->typefind && ! filter->typefind_done) {
+    gst_event_take (&filter->typefind_segment, event);
+    return TRUE;
+  }
+
+  return gst_pad_push_event (filter->srcpad, event);
+}
+
+/* Collect decoded output until TYPEFIND_SIZE bytes (or, with force, the
+ * end of the stream), then set the src caps from what the typefinders
+ * make of it and push the segment and the held back data. The gzip file
+ * name extension breaks ties and is the last resort for data nothing
+ * recognizes. Without a result no caps are set, as without typefind.
+ */
+static GstFlowReturn
+gst_gzdec_typefind (GstGzdec * filter, GstBuffer * buf, gboolean force)
+{
+  GstTypeFindProbability prob = GST_TYPE_FIND_NONE;
+  GstCaps *caps = NULL;
+
+  if (buf != NULL && filter->typefind_buf != NULL) {
+    guint64 offset_end = GST_BUFFER_OFFSET_END (buf);
+
+    filter->typefind_buf = gst_buffer_append (filter->typefind_buf, buf);
+    GST_BUFFER_OFFSET_END (filter->typefind_buf) = offset_end;
+  } else if (buf != NULL) {
+    filter->typefind_buf = buf;
+  }
+
+  if (! filter->typefind || filter->typefind_done)
+    return GST_FLOW_OK;
+  if (! force && (filter->typefind_buf == NULL
+          || gst_buffer_get_size (filter->typefind_buf) < TYPEFIND_SIZE))
+    return GST_FLOW_OK;
+
+  filter->typefind_done = TRUE;
+
+  if (filter->typefind_buf != NULL)
+    caps = gst_type_find_helper_for_buffer_with_extension (
+        GST_OBJECT (filter), filter->typefind_buf, filter->typefind_hint,
+        &prob);
+  if (caps != NULL && prob < GST_TYPE_FIND_POSSIBLE)
+    gst_clear_caps (&caps);
+  if (caps == NULL && filter->typefind_hint != NULL)
+    caps = gst_type_find_helper_for_extension (GST_OBJECT (filter),
+        filter->typefind_hint);
+
+  if (caps != NULL) {
+    GST_DEBUG_OBJECT (filter, "output typefound as %" GST_PTR_FORMAT
+        " (probability %d)", caps, prob);
+    gst_pad_push_event (filter->srcpad, gst_event_new_caps (caps));
+    gst_caps_unref (caps);
+  } else {
+    GST_DEBUG_OBJECT (filter, "could not typefind the output");
+  }
+
+  if (filter->typefind_segment != NULL)
+    gst_pad_push_event (filter->srcpad,
+        g_steal_pointer (&filter->typefind_segment));
+
+  if (filter->typefind_buf == NULL)
+    return GST_FLOW_OK;
+  return gst_gzdec_push_buffer (filter,
+      g_steal_pointer (&filter->typefind_buf));
+}
+
+static void
+gst_gzdec_typefind_reset (GstGzdec * filter)
+{
+  gst_clear_buffer (&filter->typefind_buf);
+  gst_clear_event (&filter->typefind_segment);
+  g_clear_pointer (&filter->typefind_hint, g_free);
+  filter->typefind_done = FALSE;
+}
+
+static void
+gst_gzdec_reset_stats (GstGzdec * filter)
+{
+  GST_OBJECT_LOCK (filter);
+  filter->stats_buffers     = 0;
+  filter->stats_chunks      = 0;
+  filter->stats_decode_time = 0;
+  filter->stats_push_time   = 0;
+  memset (filter->stats_decode_hist, 0, sizeof (filter->stats_decode_hist));
+  filter->stats_last_post   = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (filter);
+}
+
+/* Snapshot for the stats property, the element messages and the
+ * gzdecstats tracer. The counters are only written by the streaming
+ * thread, the times and the histogram under the object lock.
+ */
+static GstStructure *
+gst_gzdec_get_stats (GstGzdec * filter)
+{
+  GValue hist = G_VALUE_INIT;
+  GstStructure * s;
+  guint i;
+
+  g_value_init (&hist, GST_TYPE_ARRAY);
+
+  GST_OBJECT_LOCK (filter);
+  for (i = 0; i < GZDEC_STATS_BUCKETS; i++) {
+    GValue count = G_VALUE_INIT;
+
+    g_value_init (&count, G_TYPE_UINT64);
+    g_value_set_uint64 (&count, filter->stats_decode_hist[i]);
+    gst_value_array_append_and_take_value (&hist, &count);
+  }
+
+  s = gst_structure_new ("application/x-gzdec-stats",
+      "bytes-in", G_TYPE_UINT64, filter->bytes_in,
+      "bytes-out", G_TYPE_UINT64, filter->bytes_out,
+      "ratio", G_TYPE_DOUBLE, filter->bytes_in > 0
+          ? (gdouble) filter->bytes_out / filter->bytes_in : 0.0,
+      "buffers", G_TYPE_UINT64, filter->stats_buffers,
+      "chunks", G_TYPE_UINT64, filter->stats_chunks,
+      "decode-time", G_TYPE_UINT64, filter->stats_decode_time,
+      "push-time", G_TYPE_UINT64, filter->stats_push_time,
+      NULL);
+  GST_OBJECT_UNLOCK (filter);
+
+  gst_structure_take_value (s, "decode-histogram", &hist);
+  return s;
+}
+
+static void
+gst_gzdec_add_decode_time (GstGzdec * filter, GstClockTime elapsed)
+{
+  guint64 usecs = elapsed / GST_USECOND;
+  guint bucket = 0;
+
+  while (bucket < GZDEC_STATS_BUCKETS - 1
+      && usecs >= (G_GUINT64_CONSTANT (1) << bucket))
+    bucket++;
+
+  GST_OBJECT_LOCK (filter);
+  filter->stats_buffers++;
+  filter->stats_decode_time += elapsed;
+  filter->stats_decode_hist[bucket]++;
+  GST_OBJECT_UNLOCK (filter);
+}
+
+// Post the statistics if stats-interval has passed since the last time
+static void
+gst_gzdec_post_stats (GstGzdec * filter, gboolean force)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  if (! force && GST_CLOCK_TIME_IS_VALID (filter->stats_last_post)
+      && now - filter->stats_last_post
+          < filter->stats_interval * GST_MSECOND)
+    return;
+  filter->stats_last_post = now;
+
+  gst_element_post_message (GST_ELEMENT (filter),
+      gst_message_new_element (GST_OBJECT (filter),
+          gst_gzdec_get_stats (filter)));
+}
+
+/* Resume raw inflating at an index checkpoint: the bits of the byte
+ * before it that belong to the next block are primed, the window is
+ * restored and input continues at the checkpoint's compressed offset.
+ * The trailer of the member we resume in is skipped unchecked.
+ */
+static gboolean
+gst_gzdec_resume (GstGzdec * filter, const GstGzdecCheckpoint * point)
+{
+  z_stream * stream;
+  GstBuffer * buf = NULL;
+  guint8 byte;
+
+  // Raw deflate, the member header is behind us
+  filter->zlib_window_bits = -15;
+  filter->zlib_stream = stream =
+      gst_gzdec_context_acquire_inflate (filter->zlib_window_bits);
+  if (stream == NULL)
+    return FALSE;
+
+  if (point->bits > 0) {
+    if (gst_pad_pull_range (filter->sinkpad, point->in - 1, 1, &buf)
+        != GST_FLOW_OK)
+      goto error;
+    if (gst_buffer_extract (buf, 0, &byte, 1) != 1)
+      goto error;
+    gst_buffer_unref (buf);
+    buf = NULL;
+
+    if (inflatePrime (stream, point->bits, byte >> (8 - point->bits))
+        != Z_OK)
+      goto error;
+  }
+
+  if (point->window_size > 0 && inflateSetDictionary (stream,
+          point->window, point->window_size) != Z_OK)
+    goto error;
+
+  // Checkpoints are only recorded by zlib, so resume with it as well
+  filter->init_encoder    = zlib_init_encoder;
+  filter->free_encoder    = zlib_free_encoder;
+  filter->reset_encoder   = zlib_reset_encoder;
+  filter->step            = zlib_step;
+  filter->decode          = gst_gzdec_decode;
+  filter->decoder_name    = "ZLIB";
+
+  filter->raw_member  = TRUE;
+  filter->skip_in     = 0;
+  // Started inside the member, its CRC-32 cannot be checked
+  filter->zlib_check  = FALSE;
+  filter->pull_offset = point->in;
+  filter->bytes_in    = point->in;
+  filter->bytes_out   = point->out;
+  filter->pushed_out  = point->out;
+  filter->members     = 0;
+  // Inside a member, so a decoding error is never taken for padding
+  filter->member_out  = 1;
+  filter->trailing_garbage = FALSE;
+  // The members before the checkpoint were never seen
+  filter->members_counted = FALSE;
+  g_array_set_size (filter->marks, 0);
+  // Checkpoints lie inside members, too late to probe for BGZF
+  filter->par_probed  = TRUE;
+  filter->in_progress = TRUE;
+
+  return TRUE;
+
+ error:
+  {
+    if (buf != NULL)
+      gst_buffer_unref (buf);
+    gst_gzdec_context_release_inflate (stream, filter->zlib_window_bits);
+    filter->zlib_stream = NULL;
+    GST_WARNING_OBJECT (filter, "could not resume at checkpoint %"
+        G_GUINT64_FORMAT, point->out);
+    return FALSE;
+  }
+}
+
+static void
+gst_gzdec_reposition (GstGzdec * filter, guint64 target)
+{
+  const GstGzdecCheckpoint * point = NULL;
+
+  gst_gzdec_release_decoder (filter);
+  gst_gzdec_output_discard (filter);
+  // Output held back for typefinding is from before the target
+  gst_clear_buffer (&filter->typefind_buf);
+  filter->raw_member  = FALSE;
+  filter->skip_in     = 0;
+  filter->pull_offset = 0;
+
+  if (filter->index != NULL && filter->format == GST_GZDEC_FORMAT_GZIP)
+    point = gst_gzdec_index_lookup (filter->index, target);
+
+  if (point != NULL && gst_gzdec_resume (filter, point)) {
+    GST_DEBUG_OBJECT (filter, "seeking to %" G_GUINT64_FORMAT " from "
+        "checkpoint at %" G_GUINT64_FORMAT " (input %" G_GUINT64_FORMAT ")",
+        target, point->out, point->in);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (filter, "seeking to %" G_GUINT64_FORMAT " from the "
+      "start", target);
+}
+
+// CRC-32 of up to GZDEC_FINGERPRINT_SIZE bytes from offset on
+static gboolean
+gst_gzdec_fingerprint_range (GstGzdec * filter, guint64 offset, guint64 size,
+    guint32 * crc)
+{
+  while (size > 0) {
+    GstBuffer * buf = NULL;
+    GstMapInfo map;
+    gsize length;
+
+    if (gst_pad_pull_range (filter->sinkpad, offset, size, &buf)
+        != GST_FLOW_OK)
+      return FALSE;
+
+    if (! gst_buffer_map (buf, &map, GST_MAP_READ)) {
+      gst_buffer_unref (buf);
+      return FALSE;
+    }
+
+    length = MIN (map.size, size);
+    *crc = crc32 (*crc, map.data, length);
+    gst_buffer_unmap (buf, &map);
+    gst_buffer_unref (buf);
+
+    if (length == 0)
+      return FALSE;
+    offset += length;
+    size   -= length;
+  }
+
+  return TRUE;
+}
+
+/* Fingerprint matching an index to its archive: the CRC-32 of its first
+ * and last GZDEC_FINGERPRINT_SIZE bytes. Only pull mode can read them
+ * before decoding.
+ */
+static gboolean
+gst_gzdec_fingerprint (GstGzdec * filter, guint64 in_size, guint32 * crc)
+{
+  guint64 head = MIN (in_size, GZDEC_FINGERPRINT_SIZE);
+  guint64 tail = MIN (in_size - head, GZDEC_FINGERPRINT_SIZE);
+
+  if (GST_PAD_MODE (filter->sinkpad) != GST_PAD_MODE_PULL || in_size == 0)
+    return FALSE;
+
+  *crc = crc32 (0, NULL, 0);
+  return gst_gzdec_fingerprint_range (filter, 0, head, crc)
+      && gst_gzdec_fingerprint_range (filter, in_size - tail, tail, crc);
+}
+
+/* Set up the index when the stream starts: from index-location if it
+ * holds one for this stream, empty otherwise. Without a sidecar only pull
+ * mode, where seeking is possible, keeps one. A sidecar is only trusted,
+ * and only written, when the size and fingerprint of the archive are
+ * known and match it.
+ */
+static void
+gst_gzdec_open_index (GstGzdec * filter)
+{
+  GError * error = NULL;
+  gint64 in_size = 0;
+  guint32 fingerprint = 0;
+
+  if (filter->index_location == NULL
+      && (GST_PAD_MODE (filter->sinkpad) != GST_PAD_MODE_PULL
+          || filter->index_span == 0))
+    return;
+
+  if (! gst_pad_peer_query_duration (filter->sinkpad, GST_FORMAT_BYTES,
+          &in_size) || in_size < 0)
+    in_size = 0;
+
+  if (filter->index_location != NULL) {
+    filter->index_checked = gst_gzdec_fingerprint (filter, in_size,
+        &fingerprint);
+    filter->index = gst_gzdec_index_load (filter->index_location, &error);
+
+    if (filter->index == NULL) {
+      if (g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        GST_DEBUG_OBJECT (filter, "no index yet: %s", error->message);
+      else
+        GST_WARNING_OBJECT (filter, "could not load index: %s",
+            error->message);
+      g_clear_error (&error);
+    } else if (! filter->index_checked) {
+      GST_WARNING_OBJECT (filter, "cannot tell whether index %s is for "
+          "this stream, ignoring it", filter->index_location);
+      g_clear_pointer (&filter->index, gst_gzdec_index_free);
+    } else if (filter->index->format != filter->format
+        || filter->index->in_size != (guint64) in_size
+        || filter->index->fingerprint != fingerprint) {
+      GST_WARNING_OBJECT (filter, "index %s is for a different stream, "
+          "ignoring it", filter->index_location);
+      g_clear_pointer (&filter->index, gst_gzdec_index_free);
+    } else {
+      GST_INFO_OBJECT (filter, "loaded index with %u checkpoints and %u "
+          "block boundaries", filter->index->points->len,
+          filter->index->boundaries->len);
+    }
+  }
+
+  if (filter->index == NULL) {
+    filter->index = gst_gzdec_index_new ();
+    filter->index->format      = filter->format;
+    filter->index->in_size     = in_size;
+    filter->index->fingerprint = fingerprint;
+  }
+}
+
+static void
+gst_gzdec_close_index (GstGzdec * filter)
+{
+  GError * error = NULL;
+
+  if (filter->index == NULL)
+    return;
+
+  if (filter->index_write && filter->index_location != NULL
+      && filter->index->dirty && ! filter->index_checked)
+    GST_WARNING_OBJECT (filter, "not writing index %s, the archive could "
+        "not be fingerprinted", filter->index_location);
+  else if (filter->index_write && filter->index_location != NULL
+      && filter->index->dirty
+      && ! gst_gzdec_index_save (filter->index, filter->index_location,
+          &error)) {
+    GST_ELEMENT_WARNING (filter, RESOURCE, WRITE, (NULL),
+        ("could not write index: %s", error->message));
+    g_clear_error (&error);
+  }
+
+  g_clear_pointer (&filter->index, gst_gzdec_index_free);
+}
+
+// The whole input has been decoded, remember the decoded size
+static void
+gst_gzdec_complete_index (GstGzdec * filter)
+{
+  if (filter->in_progress)
+    filter->duration = filter->bytes_out;
+
+  if (filter->index == NULL || ! filter->in_progress
+      || filter->index->total_out == filter->bytes_out)
+    return;
+
+  filter->index->total_out = filter->bytes_out;
+  filter->index->dirty     = TRUE;
+}
+
+// True if the start of a stream inflates as raw deflate
+static gboolean
+gst_gzdec_probe_deflate (const guint8 * data, gsize size)
+{
+  z_stream stream;
+  guint8 out[4096];
+  int status;
+
+  memset (&stream, 0, sizeof (stream));
+  stream.zalloc = gst_gzdec_zalloc;
+  stream.zfree  = gst_gzdec_zfree;
+  if (inflateInit2 (&stream, -15) != Z_OK)
+    return FALSE;
+
+  stream.next_in   = (Bytef *) data;
+  stream.avail_in  = MIN (size, 4096);
+  stream.next_out  = out;
+  stream.avail_out = sizeof (out);
+  status = inflate (&stream, Z_NO_FLUSH);
+  inflateEnd (&stream);
+
+  /* Needing more input or output is fine, as long as something decoded:
+   * a few bytes of anything else often get that far without an error
+   */
+  return status == Z_STREAM_END || ((status == Z_OK || status == Z_BUF_ERROR)
+      && stream.total_out > 0);
+}
+
+/* Lower case extension of the original file name (FNAME) in the gzip
+ * header at data, NULL if there is none or the header is longer than
+ * size.
+ */
+static gchar *
+gst_gzdec_gzip_extension (const guint8 * data, gsize size)
+{
+  const gchar *name, *ext;
+  gsize pos = 10;
+
+  if (size < pos || (data[3] & 0x08) == 0)
+    return NULL;
+  // FEXTRA comes first
+  if (data[3] & 0x04) {
+    if (size < pos + 2)
+      return NULL;
+    pos += 2 + GST_READ_UINT16_LE (data + pos);
+  }
+  if (pos >= size || memchr (data + pos, 0, size - pos) == NULL)
+    return NULL;
+
+  name = (const gchar *) data + pos;
+  ext = strrchr (name, '.');
+  if (ext == NULL || ext[1] == '\0' || strchr (ext, '/') != NULL)
+    return NULL;
+
+  return g_ascii_strdown (ext + 1, -1);
+}
+
+/* Identify the stream from the first bytes of buf, unless the format
+ * property or the caps say zlib or raw deflate. When nothing matches the
+ * format from the caps (gzip by default) stays. FALSE for formats we can
+ * recognize but not decode.
+ */
+static gboolean
+gst_gzdec_detect_format (GstGzdec * filter, GstBuffer * buf)
+{
+  static const guint8 xz_magic[6] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+  static const guint8 zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+  static const guint8 lz4_magic[4] = { 0x04, 0x22, 0x4d, 0x18 };
+  // Copied out, mapping a buffer of several memories would merge them
+  guint8 data[4096];
+  gsize size;
+  gboolean ret = TRUE;
+  gboolean dictionary;
+  GstGzdecInputFormat input_format = filter->input_format;
+
+  if (input_format == GST_GZDEC_INPUT_FORMAT_AUTO)
+    input_format = filter->caps_format;
+  if (input_format != GST_GZDEC_INPUT_FORMAT_AUTO) {
+    filter->format = input_format == GST_GZDEC_INPUT_FORMAT_ZLIB
+        ? GST_GZDEC_FORMAT_ZLIB : GST_GZDEC_FORMAT_DEFLATE;
+    return TRUE;
+  }
+
+  GST_OBJECT_LOCK (filter);
+  dictionary = filter->dictionary != NULL;
+  GST_OBJECT_UNLOCK (filter);
+
+  size = gst_buffer_extract (buf, 0, data, sizeof (data));
+
+  if (size >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+    filter->format = GST_GZDEC_FORMAT_GZIP;
+    g_free (filter->typefind_hint);
+    filter->typefind_hint = gst_gzdec_gzip_extension (data, size);
+  } else if (size >= 4 && memcmp (data, "BZh", 3) == 0
+      && data[3] >= '1' && data[3] <= '9') {
+    filter->format = GST_GZDEC_FORMAT_BZIP2;
+  } else if (size >= 6 && memcmp (data, xz_magic, 6) == 0) {
+    GST_WARNING_OBJECT (filter, "xz streams are not supported");
+    ret = FALSE;
+  } else if (size >= 4 && memcmp (data, zstd_magic, 4) == 0) {
+#ifdef HAVE_ZSTD
+    filter->format = GST_GZDEC_FORMAT_ZSTD;
+#else
+    GST_WARNING_OBJECT (filter, "zstd support not compiled in");
+    ret = FALSE;
+#endif
+  } else if (size >= 4 && memcmp (data, lz4_magic, 4) == 0) {
+#ifdef HAVE_LZ4
+    filter->format = GST_GZDEC_FORMAT_LZ4;
+#else
+    GST_WARNING_OBJECT (filter, "LZ4 support not compiled in");
+    ret = FALSE;
+#endif
+  } else if (size >= 2 && (data[0] & 0x0f) == Z_DEFLATED
+      && (data[0] >> 4) <= 7 && (dictionary || (data[1] & 0x20) == 0)
+      && GST_READ_UINT16_BE (data) % 31 == 0) {
+    // CMF and FLG of a zlib header, FDICT only if we have a dictionary
+    filter->format = GST_GZDEC_FORMAT_ZLIB;
+  } else if (! filter->caps_named && gst_gzdec_probe_deflate (data, size)) {
+    // No magic at all, and the caps did not say either
+    filter->format = GST_GZDEC_FORMAT_DEFLATE;
+  }
+
+  GST_DEBUG_OBJECT (filter, "stream format %d", filter->format);
+  return ret;
+}
+
+/* Pick the functions decoding the current format. For gzip the backend
+ * property decides; backends that were not compiled in fall back to zlib.
+ * Only zlib can skip the check for verify off.
+ */
+static void
+gst_gzdec_select_decoder (GstGzdec * filter)
+{
+  GstGzdecBackend backend = filter->backend;
+
+  filter->encode          = gst_gzdec_encode;
+  filter->decode          = gst_gzdec_decode;
+
+  if (filter->format == GST_GZDEC_FORMAT_BZIP2) {
+    filter->init_encoder    = bzlib_init_encoder;
+    filter->free_encoder    = bzlib_free_encoder;
+    filter->reset_encoder   = bzlib_reset_encoder;
+    filter->step            = bzlib_step;
+    filter->decode_parallel = bzlib_decode_parallel;
+    filter->decoder_name    = "BZLIB";
+    return;
+  }
+
+#ifdef HAVE_ZSTD
+  if (filter->format == GST_GZDEC_FORMAT_ZSTD) {
+    filter->init_encoder    = zstd_init_encoder;
+    filter->free_encoder    = zstd_free_encoder;
+    filter->reset_encoder   = zstd_reset_encoder;
+    filter->step            = zstd_step;
+    filter->decode_parallel = gst_gzdec_decode_frames;
+    filter->frame_size      = gst_gzdec_zstd_frame_size;
+    filter->job_func        = gst_gzdec_job_zstd;
+    filter->decoder_name    = "ZSTD";
+    return;
+  }
+#endif
+
+#ifdef HAVE_LZ4
+  if (filter->format == GST_GZDEC_FORMAT_LZ4) {
+    filter->init_encoder    = lz4_init_encoder;
+    filter->free_encoder    = lz4_free_encoder;
+    filter->reset_encoder   = lz4_reset_encoder;
+    filter->step            = lz4_step;
+    filter->decode_parallel = gst_gzdec_decode_frames;
+    filter->frame_size      = gst_gzdec_lz4_frame_size;
+    filter->job_func        = gst_gzdec_job_lz4;
+    filter->decoder_name    = "LZ4";
+    return;
+  }
+#endif
+
+  filter->init_encoder    = zlib_init_encoder;
+  filter->free_encoder    = zlib_free_encoder;
+  filter->reset_encoder   = zlib_reset_encoder;
+  filter->step            = zlib_step;
+  filter->decode_parallel = gst_gzdec_decode_frames;
+  filter->frame_size      = gst_gzdec_bgzf_frame_size;
+  filter->job_func        = gst_gzdec_job_inflate;
+  filter->decoder_name    = "ZLIB";
+
+  // The other backends only know about gzip
+  if (filter->format != GST_GZDEC_FORMAT_GZIP)
+    return;
+
+  // libdeflate always checks the trailer
+  if (backend == GST_GZDEC_BACKEND_AUTO
+      && filter->verify == GST_GZDEC_VERIFY_OFF)
+    backend = GST_GZDEC_BACKEND_ZLIB;
+
+  if (backend == GST_GZDEC_BACKEND_AUTO) {
+#ifdef HAVE_LIBDEFLATE
+    backend = GST_GZDEC_BACKEND_LIBDEFLATE;
+#else
+    backend = GST_GZDEC_BACKEND_ZLIB;
+#endif
+  }
+
+  switch (backend) {
+#ifdef HAVE_LIBDEFLATE
+    case GST_GZDEC_BACKEND_LIBDEFLATE:
+      filter->init_encoder  = libdeflate_init_encoder;
+      filter->free_encoder  = libdeflate_free_encoder;
+      filter->decode        = libdeflate_decode;
+      filter->job_func      = gst_gzdec_job_libdeflate;
+      break;
+#endif
+    case GST_GZDEC_BACKEND_ZLIB:
+      break;
+    default:
+      GST_WARNING_OBJECT (filter, "backend %d not available, using zlib",
+          backend);
+      break;
+  }
+
+  GST_DEBUG_OBJECT (filter, "decoding gzip with backend %d", backend);
+}
+
+/* Input buffers reassembled upstream (rtp depayloaders, tcpclientsrc)
+ * often hold several memories. Mapping the buffer as a whole would merge
+ * them into a copy, so each memory is mapped and decoded on its own; the
+ * decoders already carry their state from one call to the next.
+ */
+static GstFlowReturn
+gst_gzdec_encode_buffer (GstGzdec * filter,
+    GstBuffer * inbuf, GstBuffer ** outbuf)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i, n_memory;
+
+  n_memory = gst_buffer_n_memory (inbuf);
+  for (i = 0; i < n_memory && ret == GST_FLOW_OK; i++) {
+    GstMemory * mem = gst_buffer_peek_memory (inbuf, i);
+    GstMapInfo map_info_in;
+
+    if (! gst_memory_map (mem, &map_info_in, GST_MAP_READ))
+      return GST_FLOW_ERROR;
+
+    if (map_info_in.size > 0) {
+      if (filter->threads != 1
+          && (filter->parallel != NULL || ! filter->par_probed))
+        ret = filter->decode_parallel (filter, map_info_in.data,
+            map_info_in.size, outbuf);
+      else
+        ret = filter->decode (filter, map_info_in.data, map_info_in.size,
+            outbuf);
+    }
+
+    gst_memory_unmap (mem, &map_info_in);
+  }
+
+  return ret;
+}
+
+/* Decode the input buffers, a batch of them with min-input-bytes, into
+ * one output buffer carrying the metadata of the first one.
+ */
+static GstFlowReturn
+gst_gzdec_encode (GstGzdec * filter,
+    GstBuffer ** inbufs, guint n_inbufs, GstBuffer ** outbuf)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i;
+
+  *outbuf = gst_buffer_new();
+  if (*outbuf == NULL)
+    goto no_buffer;
+  
+  // The offsets are set for decoded bytes on pushing, see gst_gzdec_push
+  gst_gzdec_copy_timestamps (*outbuf, inbufs[0]);
+
+  // A batch lasts as long as its buffers together
+  for (i = 1; i < n_inbufs && GST_BUFFER_DURATION_IS_VALID (*outbuf); i++) {
+    if (GST_BUFFER_DURATION_IS_VALID (inbufs[i]))
+      GST_BUFFER_DURATION (*outbuf) += GST_BUFFER_DURATION (inbufs[i]);
+    else
+      GST_BUFFER_DURATION (*outbuf) = GST_CLOCK_TIME_NONE;
+  }
+
+  for (i = 0; i < n_inbufs && ret == GST_FLOW_OK; i++)
+    ret = gst_gzdec_encode_buffer (filter, inbufs[i], outbuf);
+
+  if (ret == GST_FLOW_OK)
+    gst_gzdec_output_finish (filter, outbuf);
+  else
+    gst_gzdec_output_discard (filter);
+
+  return ret;
+
+ no_buffer:
+  {
+    GST_WARNING_OBJECT (filter, "could not allocate buffer");
+    return GST_FLOW_ERROR;
+  }
+}
+
+/* Decode data on the streaming thread, appending the output to outbuf.
+ * The backend's step function runs one decompression call; everything
+ * around it (output space, statistics, member boundaries, trailing
+ * garbage) is handled here.
+ */
+static GstFlowReturn
+gst_gzdec_decode (GstGzdec * filter, const guint8 * data, gsize size,
+    GstBuffer ** outbuf)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstGzdecStep step;
+  guint8 * out_data;
+  gsize out_size, avail_out;
+
+  if (G_UNLIKELY (filter->trailing_garbage))
+    return GST_FLOW_OK;
+
+  /* Keep going while there is input left, and also while the decoder
+   * fills the whole output space: it may be holding back more data */
+  do {
+    gsize avail_in = size;
+    gsize produced;
+
+    ret = gst_gzdec_output_reserve (filter, avail_in, &out_data, &out_size);
+    if (ret != GST_FLOW_OK)
+      goto output_error;
+
+    avail_out = out_size;
+    step = filter->step (filter, &data, &size, &out_data, &avail_out);
+    if (step == GST_GZDEC_STEP_ERROR) {
+      /* Like gzip(1) and bzip2(1), ignore what follows the last member if
+       * it does not even start like one, e.g. tape padding */
+      if (filter->members > 0 && filter->member_out == 0
+          && avail_out == out_size) {
+        GST_WARNING_OBJECT (filter, "ignoring trailing garbage after %u "
+            "members", filter->members);
+        filter->trailing_garbage = TRUE;
+        return gst_gzdec_output_commit (filter, outbuf, 0);
+      }
+      ret = GST_FLOW_ERROR;
+      goto decompress_error;
+    }
+
+    produced = out_size - avail_out;
+    filter->bytes_in   += avail_in - size;
+    filter->bytes_out  += produced;
+    filter->member_out += produced;
+
+    ret = gst_gzdec_output_commit (filter, outbuf, produced);
+    if (ret != GST_FLOW_OK)
+      goto output_error;
+
+    // No progress possible until more input arrives
+    if (step == GST_GZDEC_STEP_NEED_INPUT)
+      break;
+
+    /* Concatenated members (pigz, pbzip2, logrotate) simply continue with
+     * the next one, possibly from the bytes left in this very buffer */
+    if (step == GST_GZDEC_STEP_STREAM_END) {
+      filter->members++;
+      filter->member_out = 0;
+      if (! filter->reset_encoder (filter)) {
+        ret = GST_FLOW_ERROR;
+        goto decompress_error;
+      }
+      // After a resumed member its trailer is still to be skipped
+      gst_gzdec_mark_member (filter, filter->members,
+          filter->bytes_in + filter->skip_in, filter->bytes_out);
+      if (size == 0)
+        break;
+    }
+  } while (size > 0 || avail_out == 0);
+
+  return GST_FLOW_OK;
+
+ output_error:
+  {
+    GST_DEBUG_OBJECT (filter, "could not output decoded data: %s",
+        gst_flow_get_name (ret));
+    return ret;
+  }
+
+ decompress_error:
+  {
+    GST_WARNING_OBJECT (filter, "could not decompress stream: %s_ERROR(%d)",
+         filter->decoder_name, filter->decoder_error);
+    return ret;
+  }
+}
+
+#define windowBits 15
+#define ENABLE_GZIP 16
+
+/* Unless verify is full, zlib neither computes nor compares the check
+ * value; it still parses headers and trailers. For hardware zlib_step
+ * computes the gzip CRC-32 itself, the zlib Adler-32 is cheap enough to
+ * leave to zlib. A context fresh from the pool always checks.
+ */
+static gboolean
+zlib_set_verify (GstGzdec * filter)
+{
+  gboolean gzip = filter->zlib_window_bits == (windowBits | ENABLE_GZIP);
+  gboolean check;
+
+  filter->zlib_check = gzip && filter->verify == GST_GZDEC_VERIFY_HARDWARE;
+  filter->member_crc = 0;
+  if (filter->zlib_check)
+    GST_DEBUG_OBJECT (filter, "checking gzip CRC-32 with %s",
+        gst_gzdec_crc32_impl ());
+
+  check = filter->verify == GST_GZDEC_VERIFY_FULL
+      || (filter->verify == GST_GZDEC_VERIFY_HARDWARE && ! gzip);
+
+  return inflateValidate (filter->zlib_stream, check) == Z_OK;
+}
+
+/* zlib asks for the dictionary with Z_NEED_DICT and checks its Adler-32,
+ * raw deflate has no header, so the dictionary is set before every
+ * stream. Z_NEED_DICT if there is none.
+ */
+static int
+zlib_set_dictionary (GstGzdec * filter)
+{
+  GBytes * dictionary;
+  gconstpointer data;
+  gsize size;
+  int ret;
+
+  GST_OBJECT_LOCK (filter);
+  dictionary = filter->dictionary != NULL
+      ? g_bytes_ref (filter->dictionary) : NULL;
+  GST_OBJECT_UNLOCK (filter);
+
+  if (dictionary == NULL)
+    return Z_NEED_DICT;
+
+  data = g_bytes_get_data (dictionary, &size);
+  ret = inflateSetDictionary (filter->zlib_stream, data,
+      MIN (size, G_MAXUINT));
+  g_bytes_unref (dictionary);
+
+  return ret;
+}
+
+static gboolean
+zlib_init_encoder (GstGzdec * filter)
+{
+  int ret;
+
+  switch (filter->format) {
+    case GST_GZDEC_FORMAT_ZLIB:
+      filter->zlib_window_bits = filter->window_bits;
+      break;
+    case GST_GZDEC_FORMAT_DEFLATE:
+      filter->zlib_window_bits = - (gint) filter->window_bits;
+      break;
+    default:
+      filter->zlib_window_bits = windowBits | ENABLE_GZIP;
+      break;
+  }
+
+  // A reset context from the shared pool, see gstgzdeccontext.c
+  filter->zlib_stream =
+      gst_gzdec_context_acquire_inflate (filter->zlib_window_bits);
+  if (filter->zlib_stream == NULL)
+    return FALSE;
+
+  if (filter->format == GST_GZDEC_FORMAT_DEFLATE) {
+    ret = zlib_set_dictionary (filter);
+    if (ret != Z_OK && ret != Z_NEED_DICT)
+      return FALSE;
+  }
+
+  return zlib_set_verify (filter);
+}
+
+static gboolean
+zlib_free_encoder (GstGzdec * filter)
+{
+  gst_gzdec_context_release_inflate (filter->zlib_stream,
+      filter->zlib_window_bits);
+  filter->zlib_stream = NULL;
+  
+  return TRUE;
+}
+
+/* Prepare for the next gzip member, keeping the inflate state and window
+ * allocated. A member resumed at a checkpoint ends before its trailer,
+ * which zlib_step skips before parsing the next header.
+ */
+static gboolean
+zlib_reset_encoder (GstGzdec * filter)
+{
+  if (G_UNLIKELY (filter->raw_member)) {
+    filter->raw_member = FALSE;
+    filter->skip_in    = 8;
+    filter->zlib_window_bits = windowBits | ENABLE_GZIP;
+    if (inflateReset2(filter->zlib_stream, filter->zlib_window_bits)
+        != Z_OK)
+      return FALSE;
+    return zlib_set_verify (filter);
+  }
+
+  // inflateReset keeps the check disabled
+  filter->member_crc = 0;
+  if (inflateReset(filter->zlib_stream) != Z_OK)
+    return FALSE;
+
+  if (filter->format == GST_GZDEC_FORMAT_DEFLATE) {
+    int ret = zlib_set_dictionary (filter);
+
+    return ret == Z_OK || ret == Z_NEED_DICT;
+  }
+  return TRUE;
+}
+
+/* Record a checkpoint at the deflate block boundary inflate stopped at.
+ * consumed and produced are what the current step has done so far, the
+ * statistics are only updated once it returns.
+ */
+static void
+zlib_add_checkpoint (GstGzdec * filter, gsize consumed, gsize produced)
+{
+  z_stream * stream = filter->zlib_stream;
+  guint8 window[GZDEC_WINDOW_SIZE];
+  uInt window_size = sizeof (window);
+
+  if (inflateGetDictionary (stream, window, &window_size) != Z_OK)
+    return;
+
+  gst_gzdec_index_add (filter->index, filter->bytes_in + consumed,
+      filter->bytes_out + produced, stream->data_type & 7, window,
+      window_size);
+}
+
+/* Keep the last 8 bytes inflate consumed, ending at end: the trailer
+ * once a member ends, possibly spread over several buffers.
+ */
+static void
+zlib_keep_tail (GstGzdec * filter, const guint8 * end, gsize consumed)
+{
+  guint8 * tail = filter->member_tail;
+
+  if (consumed >= 8) {
+    memcpy (tail, end - 8, 8);
+  } else if (consumed > 0) {
+    memmove (tail, tail + consumed, 8 - consumed);
+    memcpy (tail + 8 - consumed, end - consumed, consumed);
+  }
+}
+
+// Compare the trailer of the member that just ended with its output
+static gboolean
+zlib_check_trailer (GstGzdec * filter, gsize produced)
+{
+  guint32 crc   = GST_READ_UINT32_LE (filter->member_tail);
+  guint32 isize = GST_READ_UINT32_LE (filter->member_tail + 4);
+  guint32 size  = filter->member_out + produced;
+
+  if (crc == filter->member_crc && isize == size)
+    return TRUE;
+
+  GST_WARNING_OBJECT (filter, "gzip member has CRC-32 %08x and size %u, "
+      "its trailer says %08x and %u", filter->member_crc, size, crc, isize);
+  return FALSE;
+}
+
+static GstGzdecStep
+zlib_step (GstGzdec * filter, const guint8 ** in, gsize * in_size,
+    guint8 ** out, gsize * out_size)
+{
+  z_stream * stream = filter->zlib_stream;
+  uInt avail_in;
+  uInt avail_out = MIN (*out_size, G_MAXUINT);
+  int flush = Z_NO_FLUSH;
+  gsize skip = 0;
+  int status;
+
+  if (G_UNLIKELY (filter->skip_in > 0)) {
+    skip = MIN (filter->skip_in, *in_size);
+
+    *in      += skip;
+    *in_size -= skip;
+    filter->skip_in -= skip;
+  }
+  avail_in = MIN (*in_size, G_MAXUINT);
+
+  stream->next_in   = (Bytef *) *in;
+  stream->avail_in  = avail_in;
+  stream->next_out  = *out;
+  stream->avail_out = avail_out;
+
+  // Stop at the next block boundary once a checkpoint is due
+  if (filter->index != NULL && filter->format == GST_GZDEC_FORMAT_GZIP
+      && filter->bytes_out
+      >= gst_gzdec_index_last_out (filter->index) + filter->index_span)
+    flush = Z_BLOCK;
+
+  status = inflate(stream, flush);
+  // Past the zlib header, which names the dictionary by its Adler-32
+  if (G_UNLIKELY (status == Z_NEED_DICT))
+    status = zlib_set_dictionary (filter);
+
+  if (flush == Z_BLOCK && status == Z_OK && (stream->data_type & 128)
+      && ! (stream->data_type & 64))
+    zlib_add_checkpoint (filter, skip + avail_in - stream->avail_in,
+        avail_out - stream->avail_out);
+
+  if (filter->zlib_check) {
+    gsize consumed = avail_in - stream->avail_in;
+    gsize produced = avail_out - stream->avail_out;
+
+    filter->member_crc = gst_gzdec_crc32 (filter->member_crc, *out,
+        produced);
+    zlib_keep_tail (filter, *in + consumed, consumed);
+    if (status == Z_STREAM_END && ! zlib_check_trailer (filter, produced))
+      status = Z_DATA_ERROR;
+  }
+
+  *in       += avail_in - stream->avail_in;
+  *in_size  -= avail_in - stream->avail_in;
+  *out      += avail_out - stream->avail_out;
+  *out_size -= avail_out - stream->avail_out;
+
+  switch (status) {
+  case Z_OK:
+    return GST_GZDEC_STEP_OK;
+  case Z_STREAM_END:
+    return GST_GZDEC_STEP_STREAM_END;
+  case Z_BUF_ERROR:
+    return GST_GZDEC_STEP_NEED_INPUT;
+  default:
+    filter->decoder_error = status;
+    return GST_GZDEC_STEP_ERROR;
+  }
+}
+
+#ifdef HAVE_LIBDEFLATE
+// Largest member decoded in one go, bigger ones are streamed through zlib
+#define LIBDEFLATE_MAX_MEMBER (64 * 1024 * 1024)
+
+static gboolean
+libdeflate_init_encoder (GstGzdec * filter)
+{
+  filter->deflate = libdeflate_alloc_decompressor ();
+  if (filter->deflate == NULL)
+    return FALSE;
+
+  return zlib_init_encoder (filter);
+}
+
+static gboolean
+libdeflate_free_encoder (GstGzdec * filter)
+{
+  g_clear_pointer (&filter->deflate, libdeflate_free_decompressor);
+
+  return zlib_free_encoder (filter);
+}
+
+/* libdeflate only decodes whole members. Every member that starts and
+ * ends within data is decoded in one call into a single memory; a member
+ * cut by the end of the buffer, or too big to hold at once, is streamed
+ * through zlib instead.
+ */
+static GstFlowReturn
+libdeflate_decode (GstGzdec * filter, const guint8 * data, gsize size,
+    GstBuffer ** outbuf)
+{
+  GstFlowReturn ret;
+  gsize limit = LIBDEFLATE_MAX_MEMBER;
+
+  if (filter->max_output_buffer_size > 0)
+    limit = MIN (limit, filter->max_output_buffer_size);
+
+  // Only at member boundaries, zlib may be in the middle of one
+  while (size > 0 && filter->zlib_stream->total_in == 0
+      && ! filter->trailing_garbage) {
+    enum libdeflate_result result;
+    gsize out_size, actual_in, actual_out;
+    GstMemory * mem;
+    GstMapInfo map;
+
+    gst_gzdec_mark_member (filter, filter->members, filter->bytes_in,
+        filter->bytes_out);
+    out_size = CLAMP (gst_gzdec_output_estimate (filter, size),
+        filter->output_chunk_size, limit);
+
+    while (TRUE) {
+      mem = gst_allocator_alloc (filter->allocator, out_size,
+          &filter->params);
+      if (mem == NULL || ! gst_memory_map (mem, &map, GST_MAP_WRITE)) {
+        if (mem != NULL)
+          gst_memory_unref (mem);
+        return GST_FLOW_ERROR;
+      }
+
+      result = libdeflate_gzip_decompress_ex (filter->deflate, data, size,
+          map.data, out_size, &actual_in, &actual_out);
+      gst_memory_unmap (mem, &map);
+
+      if (result != LIBDEFLATE_INSUFFICIENT_SPACE || out_size >= limit)
+        break;
+
+      gst_memory_unref (mem);
+      out_size = MIN (out_size * 2, limit);
+    }
+
+    if (result != LIBDEFLATE_SUCCESS) {
+      gst_memory_unref (mem);
+      break;
+    }
+
+    gst_memory_resize (mem, 0, actual_out);
+    filter->members++;
+    filter->member_out = 0;
+    filter->bytes_in += actual_in;
+    data += actual_in;
+    size -= actual_in;
+
+    if (actual_out == 0) {
+      gst_memory_unref (mem);
+      continue;
+    }
+
+    ret = gst_gzdec_output_append (filter, outbuf, mem);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  if (size == 0)
+    return GST_FLOW_OK;
+
+  return gst_gzdec_decode (filter, data, size, outbuf);
+}
+#endif
+
+/* Decode frames whose sizes are known without decoding them, BGZF
+ * blocks and zstd or LZ4 frames with a content size, on the worker pool.
+ * Whole frames are cut straight from the input, a partial one waits in
+ * par_pending for the next buffer. Anything else, from the first frame on
+ * or after some, goes through the serial decoder once the workers are
+ * done.
+ */
+static GstFlowReturn
+gst_gzdec_decode_frames (GstGzdec * filter, const guint8 * data,
+    gsize size, GstBuffer ** outbuf)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize pos = 0;
+
+  if (filter->par_pending == NULL)
+    filter->par_pending = g_byte_array_new ();
+
+  if (filter->par_pending->len > 0) {
+    g_byte_array_append (filter->par_pending, data, size);
+    data = filter->par_pending->data;
+    size = filter->par_pending->len;
+  }
+
+  if (! filter->par_probed) {
+    guint64 out_size;
+    gssize frame_size = filter->frame_size (data, size, &out_size);
+
+    // The first frame decides, it is at most MAX_FRAME_CONTENT_SIZE
+    if (frame_size < 0)
+      goto keep;
+
+    filter->par_probed = TRUE;
+    if (frame_size > 0)
+      filter->parallel = gst_gzdec_parallel_new (filter->threads,
+          filter->worker_affinity);
+    if (filter->parallel == NULL)
+      goto serial;
+  }
+
+  while (pos < size) {
+    guint64 out_size = 0;
+    gssize frame_size = filter->frame_size (data + pos, size - pos,
+        &out_size);
+    GstGzdecJob * job;
+
+    if (frame_size == 0)
+      goto serial;
+    if (frame_size < 0)
+      break;
+
+    ret = gst_gzdec_parallel_flush (filter, outbuf, FALSE);
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    // Empty frames, e.g. the BGZF end of file marker, need no job
+    if (out_size > 0) {
+      job = gst_gzdec_job_new (filter->job_func, data + pos, frame_size,
+          filter->allocator, &filter->params);
+      job->out_hint  = out_size;
+      job->verify    = filter->verify;
+      job->member    = filter->members;
+      job->member_in = filter->bytes_in;
+      gst_gzdec_parallel_submit (filter->parallel, job);
+    }
+
+    filter->members++;
+    filter->bytes_in += frame_size;
+    pos += frame_size;
+  }
+
+  ret = gst_gzdec_parallel_flush (filter, outbuf, FALSE);
+
+ keep:
+  gst_gzdec_parallel_keep (filter, data, size, pos);
+  return ret;
+
+ serial:
+  {
+    GST_DEBUG_OBJECT (filter, "no independent frames, decoding on the "
+        "streaming thread");
+
+    if (filter->parallel != NULL) {
+      ret = gst_gzdec_parallel_flush (filter, outbuf, TRUE);
+      g_clear_pointer (&filter->parallel, gst_gzdec_parallel_free);
+    }
+
+    // Between frames, the serial decoder starts a new member
+    gst_gzdec_mark_member (filter, filter->members, filter->bytes_in,
+        filter->bytes_out);
+    if (ret == GST_FLOW_OK)
+      ret = filter->decode (filter, data + pos, size - pos, outbuf);
+    g_byte_array_set_size (filter->par_pending, 0);
+
+    return ret;
+  }
+}
+
+#ifdef HAVE_ZSTD
+/* The decompression context is created for the first stream and only
+ * reset for the next ones, which keeps its window and buffers around.
+ */
+static gboolean
+zstd_init_encoder (GstGzdec * filter)
+{
+  if (filter->zstd_dctx == NULL)
+    filter->zstd_dctx = ZSTD_createDCtx ();
+  if (filter->zstd_dctx == NULL)
+    return FALSE;
+
+  return zstd_reset_encoder (filter);
+}
+
+static gboolean
+zstd_free_encoder (GstGzdec * filter)
+{
+  return zstd_reset_encoder (filter);
+}
+
+static gboolean
+zstd_reset_encoder (GstGzdec * filter)
+{
+  return ! ZSTD_isError (ZSTD_DCtx_reset (filter->zstd_dctx,
+          ZSTD_reset_session_only));
+}
+
+static GstGzdecStep
+zstd_step (GstGzdec * filter, const guint8 ** in, gsize * in_size,
+    guint8 ** out, gsize * out_size)
+{
+  ZSTD_inBuffer input = { *in, *in_size, 0 };
+  ZSTD_outBuffer output = { *out, *out_size, 0 };
+  size_t ret;
+
+  ret = ZSTD_decompressStream (filter->zstd_dctx, &output, &input);
+
+  *in       += input.pos;
+  *in_size  -= input.pos;
+  *out      += output.pos;
+  *out_size -= output.pos;
+
+  if (ZSTD_isError (ret)) {
+    filter->decoder_error = ZSTD_getErrorCode (ret);
+    return GST_GZDEC_STEP_ERROR;
+  }
+  // End of a frame, the next one starts with the following call
+  if (ret == 0)
+    return GST_GZDEC_STEP_STREAM_END;
+  if (*in_size == 0 && *out_size > 0)
+    return GST_GZDEC_STEP_NEED_INPUT;
+
+  return GST_GZDEC_STEP_OK;
+}
+#endif
+
+#ifdef HAVE_LZ4
+// Same lifetime as the zstd context
+static gboolean
+lz4_init_encoder (GstGzdec * filter)
+{
+  if (filter->lz4_dctx == NULL
+      && LZ4F_isError (LZ4F_createDecompressionContext (&filter->lz4_dctx,
+              LZ4F_VERSION)))
+    return FALSE;
+
+  return lz4_reset_encoder (filter);
+}
+
+static gboolean
+lz4_free_encoder (GstGzdec * filter)
+{
+  return lz4_reset_encoder (filter);
+}
+
+static gboolean
+lz4_reset_encoder (GstGzdec * filter)
+{
+  LZ4F_resetDecompressionContext (filter->lz4_dctx);
+
+  return TRUE;
+}
+
+static GstGzdecStep
+lz4_step (GstGzdec * filter, const guint8 ** in, gsize * in_size,
+    guint8 ** out, gsize * out_size)
+{
+  size_t consumed = *in_size;
+  size_t produced = *out_size;
+  size_t ret;
+
+  ret = LZ4F_decompress (filter->lz4_dctx, *out, &produced, *in, &consumed,
+      NULL);
+
+  *in       += consumed;
+  *in_size  -= consumed;
+  *out      += produced;
+  *out_size -= produced;
+
+  if (LZ4F_isError (ret)) {
+    filter->decoder_error = (gint) ret;
+    return GST_GZDEC_STEP_ERROR;
+  }
+  if (ret == 0)
+    return GST_GZDEC_STEP_STREAM_END;
+  if (*in_size == 0 && *out_size > 0)
+    return GST_GZDEC_STEP_NEED_INPUT;
+
+  return GST_GZDEC_STEP_OK;
+}
+#endif
+
+static gboolean
+bzlib_init_encoder (GstGzdec * filter)
 {
-  // Use system allocator
-  filter->bzlib_stream.bzalloc = NULL;
-  filter->bzlib_stream.bzfree  = NULL;
+  // Recycle the block buffers across streams, see gstgzdecarena.c
+  filter->bzlib_stream.bzalloc = gst_gzdec_bzalloc;
+  filter->bzlib_stream.bzfree  = gst_gzdec_bzfree;
   filter->bzlib_stream.opaque  = NULL;
   
   filter->bzlib_stream.avail_in = 0;
   filter->bzlib_stream.next_in  = NULL;
 
-  BZ2_bzDecompressInit(&filter->bzlib_stream, 0, 0);
-  
-  return TRUE;
+  return BZ2_bzDecompressInit(&filter->bzlib_stream, 0, 0) == BZ_OK;
 }
 
 static gboolean
@@ -379,80 +4375,310 @@ bzlib_free_encoder (GstGzdec * filter)
   return TRUE;
 }
 
+/* Prepare for the next concatenated stream (pbzip2). libbz2 has no reset
+ * call, so the decompressor is reinitialized in place.
+ */
+static gboolean
+bzlib_reset_encoder (GstGzdec * filter)
+{
+  BZ2_bzDecompressEnd(&filter->bzlib_stream);
+
+  return BZ2_bzDecompressInit(&filter->bzlib_stream, 0, 0) == BZ_OK;
+}
+
+static GstGzdecStep
+bzlib_step (GstGzdec * filter, const guint8 ** in, gsize * in_size,
+    guint8 ** out, gsize * out_size)
+{
+  bz_stream * stream = &filter->bzlib_stream;
+  unsigned int avail_in  = MIN (*in_size, G_MAXUINT);
+  unsigned int avail_out = MIN (*out_size, G_MAXUINT);
+  int status;
+
+  stream->next_in   = (char *) *in;
+  stream->avail_in  = avail_in;
+  stream->next_out  = (char *) *out;
+  stream->avail_out = avail_out;
+
+  status = BZ2_bzDecompress (stream);
+
+  *in       += avail_in - stream->avail_in;
+  *in_size  -= avail_in - stream->avail_in;
+  *out      += avail_out - stream->avail_out;
+  *out_size -= avail_out - stream->avail_out;
+
+  switch (status) {
+  case BZ_OK:
+    return GST_GZDEC_STEP_OK;
+  case BZ_STREAM_END:
+    return GST_GZDEC_STEP_STREAM_END;
+  default:
+    filter->decoder_error = status;
+    return GST_GZDEC_STEP_ERROR;
+  }
+}
+
+/* End of the bzip2 block starting at bit: taken from the index if it has
+ * the boundary already, found by searching for the next magic (and then
+ * added to the index) otherwise. The search stops where a block of the
+ * stream level has to end. -1 if more input is needed.
+ */
+static gint64
+bzlib_block_end (GstGzdec * filter, const guint8 * data, gsize size,
+    guint64 base, guint64 bit)
+{
+  guint64 limit = bit + BZIP2_MAX_BLOCK_BITS (filter->par_level) + 48;
+  guint64 known;
+  gint64 end;
+
+  if (filter->index != NULL && gst_gzdec_index_next_boundary (filter->index,
+          base + bit + 80, &known)) {
+    guint64 magic;
+
+    known -= base;
+    if (known + 48 > (guint64) size * 8)
+      return -1;
+
+    magic = gst_gzdec_read_bits (data, known, 48);
+    if (magic == BZIP2_BLOCK_MAGIC || magic == BZIP2_EOS_MAGIC)
+      return known;
+
+    GST_WARNING_OBJECT (filter, "index does not match the stream at bit %"
+        G_GUINT64_FORMAT, base + known);
+  }
+
+  end = gst_gzdec_bzip2_find_magic (data, MIN (size, (limit + 7) / 8),
+      MAX (bit + 80, filter->par_scan), &filter->par_scan);
+  if (end >= 0 && filter->index != NULL)
+    gst_gzdec_index_add_boundary (filter->index, base + end);
+
+  return end;
+}
+
+// Whether a bzip2 stream header starts at byte aligned bit next
+static gboolean
+bzlib_stream_follows (const guint8 * data, gsize size, guint64 next)
+{
+  const guint8 * header = data + next / 8;
+
+  return next / 8 + 4 <= size && memcmp (header, "BZh", 3) == 0
+      && header[3] >= '1' && header[3] <= '9';
+}
+
+/* Decompress bzip2 blocks on the worker pool. Blocks are not byte aligned
+ * and carry no length, so the input is scanned for the 48 bit magic that
+ * starts the next block or ends the stream; each block found is shifted
+ * into a stream of its own. The workers check the block CRCs, the stream
+ * CRC as they are emitted. A block cut short by a false magic is joined
+ * with the next one, see bzlib_retry_block. Input that does not look
+ * like bzip2 at the start goes through the serial decoder.
+ */
 static GstFlowReturn
-bzlib_encode (GstGzdec * filter,
-    GstBuffer * inbuf, GstBuffer ** outbuf)
+bzlib_decode_parallel (GstGzdec * filter, const guint8 * data, gsize size,
+    GstBuffer ** outbuf)
 {
   GstFlowReturn ret = GST_FLOW_OK;
-  GstMemory * memory_block;
-  GstMapInfo map_info_in, map_info_out;
-  int bzlib_status = BZ_OK;
-    
-  if (! gst_buffer_map(inbuf, &map_info_in, GST_MAP_READ))
-    return GST_FLOW_ERROR;
+  guint64 bit = filter->par_bit;
+  // Input bit offset of data
+  guint64 base = filter->bytes_in * 8;
+  guint64 total;
 
-  filter->bzlib_stream.avail_in = map_info_in.size;
-  filter->bzlib_stream.next_in  = (char*) map_info_in.data;
+  if (G_UNLIKELY (filter->trailing_garbage))
+    return GST_FLOW_OK;
 
-  *outbuf = gst_buffer_new();
-  if (outbuf == NULL)
-    goto no_buffer;
-  
-  GST_BUFFER_OFFSET (*outbuf) = filter->zlib_stream.total_out;
-  gst_buffer_copy_into(inbuf, *outbuf, GST_BUFFER_COPY_METADATA, 0, -1);
+  if (filter->par_pending == NULL)
+    filter->par_pending = g_byte_array_new ();
 
-  while (filter->bzlib_stream.avail_in > 0 && bzlib_status != BZ_STREAM_END) {
+  if (filter->par_pending->len > 0) {
+    g_byte_array_append (filter->par_pending, data, size);
+    data = filter->par_pending->data;
+    size = filter->par_pending->len;
+  }
+  total = (guint64) size * 8;
 
-    memory_block = gst_allocator_alloc(NULL, OUT_BUF_SIZE, NULL);
+  if (! filter->par_probed) {
+    if (size < 10)
+      goto keep;
 
-    if (! gst_memory_map(memory_block, &map_info_out, GST_MAP_WRITE))
-      goto map_error;
+    filter->par_probed = TRUE;
+    if (memcmp (data, "BZh", 3) == 0 && data[3] >= '1' && data[3] <= '9'
+        && gst_gzdec_read_bits (data, 32, 48) == BZIP2_BLOCK_MAGIC)
+      filter->parallel = gst_gzdec_parallel_new (filter->threads,
+          filter->worker_affinity);
+    if (filter->parallel == NULL)
+      goto serial;
+  }
 
-    filter->bzlib_stream.avail_out = map_info_out.size;
-    filter->bzlib_stream.next_out  = (char*) map_info_out.data;
+  while (TRUE) {
+    GstGzdecJob * job;
+    guint64 magic;
+    gint64 end;
 
-    bzlib_status = BZ2_bzDecompress (&filter->bzlib_stream);
-    if (bzlib_status != BZ_OK && bzlib_status != BZ_STREAM_END) {
-      BZ2_bzDecompressEnd(&filter->bzlib_stream);
-      ret = GST_FLOW_ERROR;
-      goto decompress_error;
+    // Stream header, byte aligned after the previous stream
+    if (filter->par_level == 0) {
+      const guint8 * header = data + bit / 8;
+
+      if (size - bit / 8 < 4)
+        break;
+
+      if (memcmp (header, "BZh", 3) != 0
+          || header[3] < '1' || header[3] > '9') {
+        if (filter->members == 0)
+          goto corrupt;
+
+        GST_WARNING_OBJECT (filter, "ignoring trailing garbage after %u "
+            "streams", filter->members);
+        filter->trailing_garbage = TRUE;
+        bit = total;
+        break;
+      }
+
+      filter->par_level = header[3] - '0';
+      filter->par_member_in = filter->bytes_in;
+      filter->bytes_in += 4;
+      bit += 32;
+    }
+
+    if (total - bit < 48)
+      break;
+
+    magic = gst_gzdec_read_bits (data, bit, 48);
+    if (magic == BZIP2_EOS_MAGIC) {
+      gboolean stream_end = TRUE;
+      guint64 next;
+
+      if (total - bit < 80)
+        break;
+      next = (bit + 80 + 7) / 8 * 8;
+
+      /* The magic can also turn up inside a block. Another stream
+       * right after it confirms it, otherwise it only ends the stream if
+       * the block before it decoded.
+       */
+      if (! bzlib_stream_follows (data, size, next)) {
+        ret = gst_gzdec_parallel_flush (filter, outbuf, TRUE);
+        if (ret != GST_FLOW_OK)
+          return ret;
+        stream_end = filter->par_failed == NULL;
+      }
+
+      if (stream_end) {
+        ret = gst_gzdec_parallel_flush (filter, outbuf, FALSE);
+        if (ret != GST_FLOW_OK)
+          return ret;
+
+        // Checked once all blocks of the stream are decoded
+        gst_gzdec_parallel_submit (filter->parallel,
+            gst_gzdec_job_new_bzip2_end (gst_gzdec_read_bits (data,
+                    bit + 48, 32)));
+
+        filter->bytes_in += next / 8 - bit / 8;
+        filter->members++;
+        filter->par_level = 0;
+        bit = next;
+        continue;
+      }
+
+      // Block data, joined with the failed block before it
+      GST_DEBUG_OBJECT (filter, "end of stream magic at bit %"
+          G_GUINT64_FORMAT " is inside a block", base + bit);
+    } else if (magic != BZIP2_BLOCK_MAGIC) {
+      goto corrupt;
+    }
+
+    end = bzlib_block_end (filter, data, size, base, bit);
+    if (end < 0) {
+      // No magic where the next block or the end of stream has to be
+      if (total - bit > BZIP2_MAX_BLOCK_BITS (filter->par_level) + 48)
+        goto corrupt;
+      break;
     }
 
-    gst_memory_unmap(memory_block, &map_info_out);
-    gst_memory_resize(memory_block, 0, OUT_BUF_SIZE - filter->bzlib_stream.avail_out);
-    
-    gst_buffer_append_memory(*outbuf, memory_block);
+    ret = gst_gzdec_parallel_flush (filter, outbuf, FALSE);
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    job = gst_gzdec_job_new_bzip2_block (data, bit, end - bit,
+        filter->par_level);
+    job->start_bit = base + bit;
+    job->member    = filter->members;
+    job->member_in = filter->par_member_in;
+    filter->par_member_in = -1;
+    gst_gzdec_parallel_submit (filter->parallel, job);
+
+    filter->bytes_in += end / 8 - bit / 8;
+    filter->par_scan  = 0;
+    bit = end;
   }
 
-  gst_buffer_unmap(inbuf, &map_info_in);
+  ret = gst_gzdec_parallel_flush (filter, outbuf, FALSE);
 
-  if (bzlib_status == BZ_STREAM_END)
-    return GST_FLOW_EOS;
-  
-  return GST_FLOW_OK;
+ keep:
+  filter->par_bit  = bit % 8;
+  filter->par_scan = filter->par_scan > bit / 8 * 8
+      ? filter->par_scan - bit / 8 * 8 : 0;
+  gst_gzdec_parallel_keep (filter, data, size, bit / 8);
+  return ret;
 
- no_buffer:
+ serial:
   {
-    gst_buffer_unmap(inbuf, &map_info_in);
-    GST_WARNING_OBJECT (filter, "could not allocate buffer");
+    GST_DEBUG_OBJECT (filter, "not bzip2, decoding on the streaming thread");
+
+    ret = filter->decode (filter, data, size, outbuf);
+    g_byte_array_set_size (filter->par_pending, 0);
+
     return ret;
   }
 
- map_error:
+ corrupt:
   {
-    gst_buffer_unmap(inbuf, &map_info_in);
-    GST_WARNING_OBJECT (filter, "could not map memory object");
-    return ret;
+    GST_WARNING_OBJECT (filter, "could not decompress stream: corrupt "
+        "bzip2 stream at bit %" G_GUINT64_FORMAT, bit);
+    return GST_FLOW_ERROR;
   }
+}
 
- decompress_error:
-  {
-    gst_memory_unmap(memory_block, &map_info_out);
-    gst_buffer_unmap(inbuf, &map_info_in);
-    GST_WARNING_OBJECT (filter, "could not decompress stream: BZLIB_ERROR(%d)",
-         bzlib_status);
-    return ret;
+/* Typefinder for the formats in the sink template, so decodebin finds
+ * gzdec without a capsfilter. Only magics strong enough to not need the
+ * trial decoding gst_gzdec_detect_format falls back to are used here.
+ */
+static void
+gst_gzdec_type_find (GstTypeFind * tf, gpointer user_data)
+{
+  const guint8 * data = gst_type_find_peek (tf, 0, 10);
+
+  if (data == NULL)
+    return;
+
+  if (data[0] == 0x1f && data[1] == 0x8b && data[2] == Z_DEFLATED) {
+    gst_type_find_suggest_simple (tf, GST_TYPE_FIND_LIKELY,
+        "application/x-gzip", NULL);
+    return;
+  }
+
+  if (memcmp (data, "BZh", 3) == 0 && data[3] >= '1' && data[3] <= '9') {
+    guint64 magic = gst_gzdec_read_bits (data, 32, 48);
+
+    if (magic == BZIP2_BLOCK_MAGIC || magic == BZIP2_EOS_MAGIC)
+      gst_type_find_suggest_simple (tf, GST_TYPE_FIND_MAXIMUM,
+          "application/x-bzip2", NULL);
+    return;
   }
+
+#ifdef HAVE_ZSTD
+  if (GST_READ_UINT32_LE (data) == ZSTD_MAGICNUMBER) {
+    gst_type_find_suggest_simple (tf, GST_TYPE_FIND_LIKELY,
+        "application/zstd", NULL);
+    return;
+  }
+#endif
+
+#ifdef HAVE_LZ4
+  // Frame format version 01 in the FLG byte
+  if (GST_READ_UINT32_LE (data) == LZ4F_MAGICNUMBER && data[4] >> 6 == 1)
+    gst_type_find_suggest_simple (tf, GST_TYPE_FIND_LIKELY,
+        "application/x-lz4", NULL);
+#endif
 }
 
 /* entry point to initialize the plug-in
@@ -469,6 +4695,14 @@ gzdec_init (GstPlugin * gzdec)
   GST_DEBUG_CATEGORY_INIT (gst_gzdec_debug, "gzdec",
       0, "Template gzdec");
 
+  gst_type_find_register (gzdec, "gzdec_typefind", GST_RANK_MARGINAL,
+      gst_gzdec_type_find, "gz,tgz,bz2,tbz2,zst,lz4",
+      gst_static_caps_get (&typefind_caps), NULL, NULL);
+
+#ifndef GST_DISABLE_GST_TRACER_HOOKS
+  gst_tracer_register (gzdec, "gzdecstats", GST_TYPE_GZDEC_TRACER);
+#endif
+
   return GST_ELEMENT_REGISTER (gzdec, gzdec);
 }
 
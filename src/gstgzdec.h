@@ -60,7 +60,82 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (GstGzdec, gst_gzdec,
     GST, GZDEC, GstElement)
 
+typedef enum
+{
+  GST_GZDEC_FORMAT_GZIP,
+  GST_GZDEC_FORMAT_BZIP2,
+  // Inflated with zlib only
+  GST_GZDEC_FORMAT_ZLIB,
+  GST_GZDEC_FORMAT_DEFLATE,
+  // Only when compiled in
+  GST_GZDEC_FORMAT_ZSTD,
+  GST_GZDEC_FORMAT_LZ4
+} GstGzdecFormat;
+
+// format property, for streams without a magic to detect them by
+typedef enum
+{
+  GST_GZDEC_INPUT_FORMAT_AUTO,
+  GST_GZDEC_INPUT_FORMAT_ZLIB,
+  GST_GZDEC_INPUT_FORMAT_DEFLATE
+} GstGzdecInputFormat;
+
+typedef enum
+{
+  GST_GZDEC_BACKEND_AUTO,
+  GST_GZDEC_BACKEND_ZLIB,
+  GST_GZDEC_BACKEND_LIBDEFLATE
+} GstGzdecBackend;
+
+typedef enum
+{
+  GST_GZDEC_VERIFY_FULL,
+  GST_GZDEC_VERIFY_HARDWARE,
+  GST_GZDEC_VERIFY_OFF
+} GstGzdecVerify;
+
+// worker-affinity property, see gstgzdecparallel.c
+typedef enum
+{
+  GST_GZDEC_WORKER_AFFINITY_NONE,
+  GST_GZDEC_WORKER_AFFINITY_CPU,
+  GST_GZDEC_WORKER_AFFINITY_NODE
+} GstGzdecWorkerAffinity;
+
+// Outcome of a single decompression call of a backend
+typedef enum
+{
+  GST_GZDEC_STEP_OK,
+  GST_GZDEC_STEP_STREAM_END,
+  GST_GZDEC_STEP_NEED_INPUT,
+  GST_GZDEC_STEP_ERROR
+} GstGzdecStep;
+
+// See gstgzdecparallel.h, gstgzdecindex.h and gstgzdecring.h
+struct _GstGzdecJob;
+struct _GstGzdecParallel;
+struct _GstGzdecIndex;
+struct _GstGzdecRing;
+
+/* Buckets of the decode time histogram: bucket i counts the input
+ * buffers decoded in [2^(i-1), 2^i) microseconds, the last one all
+ * slower ones
+ */
+#define GZDEC_STATS_BUCKETS 16
+
+/* Where a member starts in the compressed (in) and the decoded (out)
+ * stream, see gst_gzdec_mark_member
+ */
+typedef struct
+{
+  guint    member;
+  guint64  in;
+  guint64  out;
+} GstGzdecMark;
+
 #define OUT_BUF_SIZE 4096
+// Upper bound for adaptively sized output chunks
+#define MAX_OUT_BUF_SIZE (1024 * 1024)
   
 struct _GstGzdec
 {
@@ -70,14 +145,176 @@ struct _GstGzdec
   GstPad    * srcpad;
 
   gboolean    in_progress;
+  // Pull mode, see gst_gzdec_loop
+  guint64     pull_offset;
+  gboolean    pull_started;
+  // The file upstream reads from, with the mmap property
+  GMappedFile * mapping;
+  // Output segment and the decoded offset of the next byte to push,
+  // see gst_gzdec_push
+  GstSegment  segment;
+  gboolean    need_segment;
+  guint64     pushed_out;
+  // Decoded size found by gst_gzdec_get_duration, -1 if unknown
+  gint64      duration;
+  gboolean    duration_probed;
+  GstGzdecFormat format;
+  // Output typefinding: decoded data and the segment held back until
+  // the src caps are known, and the extension of the gzip FNAME, see
+  // gst_gzdec_typefind
+  gboolean    typefind_done;
+  GstBuffer * typefind_buf;
+  GstEvent  * typefind_segment;
+  gchar     * typefind_hint;
+
+  // Properties
+  guint       output_chunk_size;
+  gboolean    adaptive_chunk_size;
+  gboolean    contiguous_output;
+  gboolean    use_buffer_pool;
+  guint       max_output_buffer_size;
+  gboolean    low_latency;
+  guint       threads;
+  GstGzdecWorkerAffinity worker_affinity;
+  gboolean    use_mmap;
+  GstGzdecBackend backend;
+  GstGzdecVerify verify;
+  guint       index_span;
+  gchar     * index_location;
+  gboolean    index_write;
+  guint       stats_interval;
+  gboolean    typefind;
+  gboolean    async;
+  guint       max_level_bytes;
+  guint       min_input_bytes;
+  GstClockTime max_input_latency;
+  gboolean    member_meta;
+  GstGzdecInputFormat input_format;
+  guint       window_bits;
+  // Preset dictionary, under the object lock
+  GBytes    * dictionary;
+  // zlib or raw deflate as announced by the caps, AUTO for other caps;
+  // whether the caps named any format at all
+  GstGzdecInputFormat caps_format;
+  gboolean    caps_named;
+  // Start of a stream too short to detect its format yet, and set while
+  // it is decoded anyway at EOS, see gst_gzdec_process
+  GstBuffer * detect_buf;
+  gboolean    draining;
+  guint       records_per_buffer;
+  gboolean    record_meta;
+
+  // Record framing: output after the last cut, held back until it holds
+  // records-per-buffer records, and the record ends found in it, see
+  // gst_gzdec_push_records
+  GstBuffer * record_pending;
+  GArray    * record_ends;
+
+  // Input queued for the src pad task in async mode, see
+  // gst_gzdec_async_loop
+  struct _GstGzdecRing * ring;
+
+  // Small input buffers decoded together, their size, the monotonic time
+  // (in us) they have to be decoded by and the flow of a batch decoded
+  // for an event, see gst_gzdec_batch_add
+  GPtrArray * batch;
+  gsize       batch_bytes;
+  gint64      batch_deadline;
+  GstFlowReturn batch_flow;
+
+  // Downstream allocation, see gst_gzdec_decide_allocation
+  gboolean              allocation_decided;
+  GstAllocator        * allocator;
+  GstAllocationParams   params;
+  GstBufferPool       * pool;
+
+  // Decoded stream statistics, used for chunk size estimation
+  guint64     bytes_in;
+  guint64     bytes_out;
+
+  // Worker pool, see gst_gzdec_decode_frames and bzlib_decode_parallel
+  struct _GstGzdecParallel * parallel;
+  GByteArray * par_pending;
+  gboolean     par_probed;
+  // bzip2 block scanner: bit offset into par_pending, where the search
+  // for the next magic resumes and stream level (0 between streams)
+  guint        par_bit;
+  guint64      par_scan;
+  gint         par_level;
+  // Stream CRC of the blocks emitted so far, and a block job that failed
+  // and waits to be joined with the next one, see bzlib_retry_block
+  guint32      par_crc;
+  struct _GstGzdecJob * par_failed;
+  // Compressed offset of the bzip2 stream whose first block is next, -1
+  // once that block is submitted
+  gint64       par_member_in;
+
+  // Seek index, only built in pull mode, see gstgzdecindex.c
+  struct _GstGzdecIndex * index;
+  // The archive size and fingerprint the index is matched against are known
+  gboolean    index_checked;
+  // Inflating raw deflate after resuming at a checkpoint, and the bytes
+  // of the member trailer still to skip once it ends
+  gboolean    raw_member;
+  guint       skip_in;
+
+  // Statistics since READY, see gst_gzdec_get_stats. bytes_in and
+  // bytes_out above count the current stream
+  guint64      stats_buffers;
+  guint64      stats_chunks;
+  GstClockTime stats_decode_time;
+  GstClockTime stats_push_time;
+  guint64      stats_decode_hist[GZDEC_STATS_BUCKETS];
+  GstClockTime stats_last_post;
+
+  // Completed gzip members / bzip2 streams
+  guint       members;
+  guint64     member_out;
+  gboolean    trailing_garbage;
+  // Member starts not pushed past yet, FALSE after resuming from the
+  // seek index, when member indices are unknown; see gst_gzdec_mark_member
+  GArray    * marks;
+  gboolean    members_counted;
+
+  // Output block being filled, see gst_gzdec_output_reserve
+  GstBuffer * out_pooled;
+  GstMemory * out_memory;
+  GstMapInfo  out_map;
+  guint8    * out_data;
+  gsize       out_size;
+  gsize       out_alloc;
   
-  z_stream    zlib_stream;
+  // Checked out of the shared pool for the stream, see gstgzdeccontext.c
+  z_stream  * zlib_stream;
+  gint        zlib_window_bits;
+  // Checking the gzip member outside of zlib: CRC-32 of its output so
+  // far and the last input bytes, the trailer once it ends, see zlib_step
+  gboolean    zlib_check;
+  guint32     member_crc;
+  guint8      member_tail[8];
   bz_stream   bzlib_stream;
+  // Optional backends, only used when compiled in
+  struct libdeflate_decompressor * deflate;
+  // Kept from one stream to the next, freed with the element
+  struct ZSTD_DCtx_s            * zstd_dctx;
+  struct LZ4F_dctx_s            * lz4_dctx;
+
+  const gchar * decoder_name;
+  gint          decoder_error;
 
-  // Private encoding funcs
+  // Private encoding funcs, see gst_gzdec_select_decoder
   gboolean(* init_encoder)(GstGzdec *);
   gboolean(* free_encoder)(GstGzdec *);
-  GstFlowReturn(* encode)(GstGzdec *, GstBuffer *, GstBuffer **);
+  gboolean(* reset_encoder)(GstGzdec *);
+  GstGzdecStep(* step)(GstGzdec *, const guint8 **, gsize *,
+      guint8 **, gsize *);
+  GstFlowReturn(* encode)(GstGzdec *, GstBuffer **, guint, GstBuffer **);
+  GstFlowReturn(* decode)(GstGzdec *, const guint8 *, gsize, GstBuffer **);
+  GstFlowReturn(* decode_parallel)(GstGzdec *, const guint8 *, gsize,
+      GstBuffer **);
+  gboolean(* job_func)(struct _GstGzdecJob *);
+  // Cuts the input into jobs, see GstGzdecFrameSizeFunc
+  gssize(* frame_size)(const guint8 *, gsize, guint64 *);
 };
 
 G_END_DECLS
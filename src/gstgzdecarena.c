@@ -0,0 +1,235 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Recycling allocator for decoder state.
+ *
+ * zlib allocates its state and 32 KiB window for every stream, libbz2
+ * about 3.6 MB for a level 9 stream. Freed blocks are kept in a process
+ * wide cache keyed by their size instead, so the next stream, in this
+ * element or another one, gets memory that is already mapped. Decoders
+ * ask for the same few sizes over and over, so exact sizes are enough.
+ *
+ * A worker pinned to a CPU or NUMA node keeps a cache of its own
+ * instead, see gst_gzdec_arena_pin_thread, so the blocks it gets back
+ * were first touched on its node rather than wherever they were freed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstgzdecarena.h"
+
+// Ahead of every block, keeps the memory handed out 16 byte aligned
+#define ARENA_HEADER_SIZE 16
+
+static GMutex arena_lock;
+// Block size to a GSList of free blocks
+static GHashTable * arena_free;
+static gsize arena_cached;
+
+typedef struct
+{
+  GHashTable * free;
+  gsize        cached;
+} ArenaLocal;
+
+static void arena_local_free (gpointer data);
+
+// Set for pinned worker threads only
+static GPrivate arena_local = G_PRIVATE_INIT (arena_local_free);
+
+// Pop a free block of size off a size to GSList table, NULL if none
+static guint8 *
+arena_take (GHashTable * table, gsize size)
+{
+  GSList * blocks;
+  guint8 * block;
+
+  if (table == NULL)
+    return NULL;
+
+  blocks = g_hash_table_lookup (table, GSIZE_TO_POINTER (size));
+  if (blocks == NULL)
+    return NULL;
+
+  block = blocks->data;
+  blocks = g_slist_delete_link (blocks, blocks);
+  if (blocks != NULL)
+    g_hash_table_insert (table, GSIZE_TO_POINTER (size), blocks);
+  else
+    g_hash_table_remove (table, GSIZE_TO_POINTER (size));
+
+  return block;
+}
+
+static void
+arena_local_free (gpointer data)
+{
+  ArenaLocal * local = data;
+  GHashTableIter iter;
+  gpointer blocks;
+
+  g_hash_table_iter_init (&iter, local->free);
+  while (g_hash_table_iter_next (&iter, NULL, &blocks))
+    g_slist_free_full (blocks, g_free);
+  g_hash_table_unref (local->free);
+  g_free (local);
+}
+
+/* From now on the calling thread allocates from and frees into a cache
+ * of its own, and allocates fresh memory rather than taking blocks from
+ * the process wide cache. For worker threads that stay on one CPU or
+ * NUMA node; the cache goes away with the thread.
+ */
+void
+gst_gzdec_arena_pin_thread (void)
+{
+  ArenaLocal * local;
+
+  if (g_private_get (&arena_local) != NULL)
+    return;
+
+  local = g_new0 (ArenaLocal, 1);
+  local->free = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_private_set (&arena_local, local);
+}
+
+gpointer
+gst_gzdec_arena_alloc (gsize size)
+{
+  ArenaLocal * local = g_private_get (&arena_local);
+  guint8 * block;
+
+  if (local != NULL) {
+    block = arena_take (local->free, size);
+    if (block != NULL)
+      local->cached -= size;
+  } else {
+    g_mutex_lock (&arena_lock);
+    block = arena_take (arena_free, size);
+    if (block != NULL)
+      arena_cached -= size;
+    g_mutex_unlock (&arena_lock);
+  }
+
+  if (block == NULL) {
+    block = g_try_malloc (ARENA_HEADER_SIZE + size);
+    if (block == NULL)
+      return NULL;
+    *(gsize *) block = size;
+  }
+
+  return block + ARENA_HEADER_SIZE;
+}
+
+void
+gst_gzdec_arena_free (gpointer mem)
+{
+  ArenaLocal * local;
+  guint8 * block;
+  gsize size;
+
+  if (mem == NULL)
+    return;
+
+  block = (guint8 *) mem - ARENA_HEADER_SIZE;
+  size = *(gsize *) block;
+
+  local = g_private_get (&arena_local);
+  if (local != NULL && local->cached + size <= GZDEC_ARENA_LOCAL_MAX_CACHED) {
+    GSList * blocks = g_hash_table_lookup (local->free,
+        GSIZE_TO_POINTER (size));
+
+    g_hash_table_insert (local->free, GSIZE_TO_POINTER (size),
+        g_slist_prepend (blocks, block));
+    local->cached += size;
+    return;
+  }
+
+  g_mutex_lock (&arena_lock);
+  if (arena_cached + size <= GZDEC_ARENA_MAX_CACHED) {
+    GSList * blocks;
+
+    if (arena_free == NULL)
+      arena_free = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    blocks = g_hash_table_lookup (arena_free, GSIZE_TO_POINTER (size));
+    g_hash_table_insert (arena_free, GSIZE_TO_POINTER (size),
+        g_slist_prepend (blocks, block));
+    arena_cached += size;
+    block = NULL;
+  }
+  g_mutex_unlock (&arena_lock);
+
+  g_free (block);
+}
+
+voidpf
+gst_gzdec_zalloc (voidpf opaque, uInt items, uInt size)
+{
+  return gst_gzdec_arena_alloc ((gsize) items * size);
+}
+
+void
+gst_gzdec_zfree (voidpf opaque, voidpf address)
+{
+  gst_gzdec_arena_free (address);
+}
+
+void *
+gst_gzdec_bzalloc (void * opaque, int n, int m)
+{
+  return gst_gzdec_arena_alloc ((gsize) n * m);
+}
+
+void
+gst_gzdec_bzfree (void * opaque, void * address)
+{
+  gst_gzdec_arena_free (address);
+}
@@ -0,0 +1,72 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_GZDEC_ARENA_H__
+#define __GST_GZDEC_ARENA_H__
+
+#include <gst/gst.h>
+#include <zlib.h>
+
+G_BEGIN_DECLS
+
+// Most bytes of free blocks kept for reuse, process wide
+#define GZDEC_ARENA_MAX_CACHED (64 * 1024 * 1024)
+// Most bytes of free blocks kept by each pinned worker thread
+#define GZDEC_ARENA_LOCAL_MAX_CACHED (16 * 1024 * 1024)
+
+gpointer gst_gzdec_arena_alloc (gsize size);
+void gst_gzdec_arena_free (gpointer mem);
+void gst_gzdec_arena_pin_thread (void);
+
+// Allocation hooks for z_stream and bz_stream
+voidpf gst_gzdec_zalloc (voidpf opaque, uInt items, uInt size);
+void gst_gzdec_zfree (voidpf opaque, voidpf address);
+void * gst_gzdec_bzalloc (void * opaque, int n, int m);
+void gst_gzdec_bzfree (void * opaque, void * address);
+
+G_END_DECLS
+
+#endif /* __GST_GZDEC_ARENA_H__ */
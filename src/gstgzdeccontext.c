@@ -0,0 +1,151 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Inflate contexts shared by all gzdec instances.
+ *
+ * Applications running many short lived elements, one per download,
+ * would otherwise set up a fresh inflate state for every stream. An
+ * element checks a context out when its stream starts and returns it at
+ * EOS; the next stream in any element gets it back reset, with its
+ * state and window still allocated. Idle contexts are kept per window
+ * size, so a reset never has to reallocate the window.
+ *
+ * libbz2 cannot reset a decompressor, bzip2 streams rely on the arena in
+ * gstgzdecarena.c instead.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstgzdeccontext.h"
+#include "gstgzdecarena.h"
+
+static GMutex context_lock;
+// Window size in bits to a GSList of idle z_streams
+static GHashTable * context_free;
+
+// Raw deflate, zlib and gzip wrappers all share the window size
+static gpointer
+context_key (gint window_bits)
+{
+  return GINT_TO_POINTER (ABS (window_bits) & 15);
+}
+
+z_stream *
+gst_gzdec_context_acquire_inflate (gint window_bits)
+{
+  z_stream * stream = NULL;
+
+  g_mutex_lock (&context_lock);
+  if (context_free != NULL) {
+    GSList * streams = g_hash_table_lookup (context_free,
+        context_key (window_bits));
+
+    if (streams != NULL) {
+      stream = streams->data;
+      streams = g_slist_delete_link (streams, streams);
+      if (streams != NULL)
+        g_hash_table_insert (context_free, context_key (window_bits),
+            streams);
+      else
+        g_hash_table_remove (context_free, context_key (window_bits));
+    }
+  }
+  g_mutex_unlock (&context_lock);
+
+  if (stream != NULL) {
+    if (inflateReset2 (stream, window_bits) == Z_OK)
+      return stream;
+
+    inflateEnd (stream);
+    g_free (stream);
+  }
+
+  stream = g_new0 (z_stream, 1);
+  stream->zalloc = gst_gzdec_zalloc;
+  stream->zfree  = gst_gzdec_zfree;
+  if (inflateInit2 (stream, window_bits) != Z_OK) {
+    g_free (stream);
+    return NULL;
+  }
+
+  return stream;
+}
+
+void
+gst_gzdec_context_release_inflate (z_stream * stream, gint window_bits)
+{
+  GSList * streams;
+
+  if (stream == NULL)
+    return;
+
+  // Drop the references into the buffers of the last stream
+  stream->next_in   = Z_NULL;
+  stream->avail_in  = 0;
+  stream->next_out  = Z_NULL;
+  stream->avail_out = 0;
+
+  g_mutex_lock (&context_lock);
+  if (context_free == NULL)
+    context_free = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  streams = g_hash_table_lookup (context_free, context_key (window_bits));
+  if (g_slist_length (streams) < GZDEC_CONTEXT_MAX_CACHED) {
+    g_hash_table_insert (context_free, context_key (window_bits),
+        g_slist_prepend (streams, stream));
+    stream = NULL;
+  }
+  g_mutex_unlock (&context_lock);
+
+  if (stream != NULL) {
+    inflateEnd (stream);
+    g_free (stream);
+  }
+}
@@ -0,0 +1,281 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* CRC-32 for verifying gzip members next to a raw inflate.
+ *
+ * zlib updates the check value with its table driven crc32 () while it
+ * inflates. On CPUs with carry-less multiplication the CRC can instead
+ * be folded 64 bytes at a time (Intel, "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction"), several times faster; ARMv8
+ * has CRC-32 instructions of its own. Whatever does not fit in the
+ * folded blocks, and CPUs with neither, go through zlib.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include <zlib.h>
+
+#include "gstgzdeccrc.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#  define GZDEC_CRC_PCLMUL
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif defined (__aarch64__) && defined (__ARM_FEATURE_CRC32)
+#  define GZDEC_CRC_ARMV8
+#  include <arm_acle.h>
+#endif
+
+typedef enum
+{
+  CRC_IMPL_ZLIB = 1,
+  CRC_IMPL_PCLMUL,
+  CRC_IMPL_ARMV8
+} CrcImpl;
+
+// Picked on first use, 0 until then
+static gsize crc_impl;
+
+static CrcImpl
+crc_get_impl (void)
+{
+  if (g_once_init_enter (&crc_impl)) {
+    gsize impl = CRC_IMPL_ZLIB;
+#if defined (GZDEC_CRC_PCLMUL)
+    guint eax, ebx, ecx, edx;
+
+    if (__get_cpuid (1, &eax, &ebx, &ecx, &edx)
+        && (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1))
+      impl = CRC_IMPL_PCLMUL;
+#elif defined (GZDEC_CRC_ARMV8)
+    impl = CRC_IMPL_ARMV8;
+#endif
+    g_once_init_leave (&crc_impl, impl);
+  }
+
+  return crc_impl;
+}
+
+static guint32
+crc_zlib (guint32 crc, const guint8 * data, gsize size)
+{
+  while (size > 0) {
+    uInt n = MIN (size, G_MAXUINT);
+
+    crc = crc32 (crc, data, n);
+    data += n;
+    size -= n;
+  }
+
+  return crc;
+}
+
+#ifdef GZDEC_CRC_PCLMUL
+/* Fold size bytes, at least 64 and a multiple of 16, into the inverted
+ * crc. The constants are x^(32*n) mod P for the bit reflected gzip
+ * polynomial, and P and its Barrett quotient for the final reduction.
+ */
+__attribute__ ((target ("pclmul,sse4.1")))
+static guint32
+crc_pclmul (guint32 crc, const guint8 * data, gsize size)
+{
+  static const guint64 k1k2[2] __attribute__ ((aligned (16))) =
+      { 0x0154442bd4, 0x01c6e41596 };
+  static const guint64 k3k4[2] __attribute__ ((aligned (16))) =
+      { 0x01751997d0, 0x00ccaa009e };
+  static const guint64 k5k0[2] __attribute__ ((aligned (16))) =
+      { 0x0163cd6124, 0x0000000000 };
+  static const guint64 poly[2] __attribute__ ((aligned (16))) =
+      { 0x01db710641, 0x01f7011641 };
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128 ((const __m128i *) (data + 0x00));
+  x2 = _mm_loadu_si128 ((const __m128i *) (data + 0x10));
+  x3 = _mm_loadu_si128 ((const __m128i *) (data + 0x20));
+  x4 = _mm_loadu_si128 ((const __m128i *) (data + 0x30));
+  x1 = _mm_xor_si128 (x1, _mm_cvtsi32_si128 (crc));
+  x0 = _mm_load_si128 ((const __m128i *) k1k2);
+  data += 64;
+  size -= 64;
+
+  // Four lanes of 128 bits, each folded 512 bits ahead
+  while (size >= 64) {
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128 (x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128 (x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128 (x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128 (x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128 (x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128 ((const __m128i *) (data + 0x00));
+    y6 = _mm_loadu_si128 ((const __m128i *) (data + 0x10));
+    y7 = _mm_loadu_si128 ((const __m128i *) (data + 0x20));
+    y8 = _mm_loadu_si128 ((const __m128i *) (data + 0x30));
+
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x5), y5);
+    x2 = _mm_xor_si128 (_mm_xor_si128 (x2, x6), y6);
+    x3 = _mm_xor_si128 (_mm_xor_si128 (x3, x7), y7);
+    x4 = _mm_xor_si128 (_mm_xor_si128 (x4, x8), y8);
+
+    data += 64;
+    size -= 64;
+  }
+
+  // Fold the lanes into one, then the remaining 16 byte blocks into it
+  x0 = _mm_load_si128 ((const __m128i *) k3k4);
+
+  x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+  x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+  x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+  x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x4), x5);
+
+  while (size >= 16) {
+    x2 = _mm_loadu_si128 ((const __m128i *) data);
+
+    x5 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128 (x1, x0, 0x11);
+    x1 = _mm_xor_si128 (_mm_xor_si128 (x1, x2), x5);
+
+    data += 16;
+    size -= 16;
+  }
+
+  // 128 to 64 bits
+  x2 = _mm_clmulepi64_si128 (x1, x0, 0x10);
+  x3 = _mm_setr_epi32 (~0, 0, ~0, 0);
+  x1 = _mm_srli_si128 (x1, 8);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  x0 = _mm_loadl_epi64 ((const __m128i *) k5k0);
+
+  x2 = _mm_srli_si128 (x1, 4);
+  x1 = _mm_and_si128 (x1, x3);
+  x1 = _mm_clmulepi64_si128 (x1, x0, 0x00);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  // Barrett reduction to 32 bits
+  x0 = _mm_load_si128 ((const __m128i *) poly);
+
+  x2 = _mm_and_si128 (x1, x3);
+  x2 = _mm_clmulepi64_si128 (x2, x0, 0x10);
+  x2 = _mm_and_si128 (x2, x3);
+  x2 = _mm_clmulepi64_si128 (x2, x0, 0x00);
+  x1 = _mm_xor_si128 (x1, x2);
+
+  return _mm_extract_epi32 (x1, 1);
+}
+#endif
+
+#ifdef GZDEC_CRC_ARMV8
+static guint32
+crc_armv8 (guint32 crc, const guint8 * data, gsize size)
+{
+  crc = ~crc;
+
+  for (; size >= 8; data += 8, size -= 8) {
+    guint64 word;
+
+    memcpy (&word, data, 8);
+    crc = __crc32d (crc, GUINT64_FROM_LE (word));
+  }
+  while (size-- > 0)
+    crc = __crc32b (crc, *data++);
+
+  return ~crc;
+}
+#endif
+
+guint32
+gst_gzdec_crc32 (guint32 crc, const guint8 * data, gsize size)
+{
+  switch (crc_get_impl ()) {
+#ifdef GZDEC_CRC_PCLMUL
+    case CRC_IMPL_PCLMUL:
+      if (size >= 64) {
+        gsize folded = size & ~(gsize) 15;
+
+        crc = ~crc_pclmul (~crc, data, folded);
+        data += folded;
+        size -= folded;
+      }
+      break;
+#endif
+#ifdef GZDEC_CRC_ARMV8
+    case CRC_IMPL_ARMV8:
+      return crc_armv8 (crc, data, size);
+#endif
+    default:
+      break;
+  }
+
+  return crc_zlib (crc, data, size);
+}
+
+const gchar *
+gst_gzdec_crc32_impl (void)
+{
+  switch (crc_get_impl ()) {
+    case CRC_IMPL_PCLMUL:
+      return "pclmul";
+    case CRC_IMPL_ARMV8:
+      return "armv8";
+    default:
+      return "zlib";
+  }
+}
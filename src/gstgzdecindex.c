@@ -0,0 +1,373 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Seek index for gzip streams, after zran.c from the zlib examples.
+ *
+ * While decoding, the element asks inflate to stop at the next deflate
+ * block boundary every index-span bytes of output and records a
+ * checkpoint there. A seek then resumes raw inflating at the last
+ * checkpoint before the target instead of at the start of the file.
+ *
+ * The index can be kept in a sidecar file, all integers little endian:
+ *
+ *   "GZDI" version:u32 format:u32 n_points:u32 n_boundaries:u32
+ *     in_size:u64 total_out:u64 fingerprint:u32
+ *   n_points times: in:u64 out:u64 bits:u32 window_size:u32
+ *     packed_size:u32 window deflated to packed_size bytes
+ *   n_boundaries times: bit:u64
+ *   CRC-32 of everything above:u32
+ *
+ * The fingerprint is the CRC-32 of the first and last GZDEC_FINGERPRINT_SIZE
+ * bytes of the archive, so an index is not used for another file that
+ * merely has the same size.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "gstgzdecindex.h"
+
+#define INDEX_MAGIC         "GZDI"
+#define INDEX_VERSION       2
+#define INDEX_HEADER_SIZE   40
+#define INDEX_POINT_SIZE    28
+
+static void
+clear_checkpoint (gpointer data)
+{
+  GstGzdecCheckpoint * point = data;
+
+  g_free (point->window);
+}
+
+GstGzdecIndex *
+gst_gzdec_index_new (void)
+{
+  GstGzdecIndex * index = g_new0 (GstGzdecIndex, 1);
+
+  index->points = g_array_new (FALSE, FALSE, sizeof (GstGzdecCheckpoint));
+  g_array_set_clear_func (index->points, clear_checkpoint);
+  index->boundaries = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  return index;
+}
+
+void
+gst_gzdec_index_free (GstGzdecIndex * index)
+{
+  if (index == NULL)
+    return;
+
+  g_array_unref (index->points);
+  g_array_unref (index->boundaries);
+  g_free (index);
+}
+
+guint64
+gst_gzdec_index_last_out (GstGzdecIndex * index)
+{
+  if (index->points->len == 0)
+    return 0;
+
+  return g_array_index (index->points, GstGzdecCheckpoint,
+      index->points->len - 1).out;
+}
+
+/* Checkpoints are only appended, so decoding a region again after a
+ * seek back does not duplicate them.
+ */
+void
+gst_gzdec_index_add (GstGzdecIndex * index, guint64 in, guint64 out,
+    guint bits, const guint8 * window, guint window_size)
+{
+  GstGzdecCheckpoint point;
+
+  if (index->points->len > 0 && out <= gst_gzdec_index_last_out (index))
+    return;
+
+  point.in          = in;
+  point.out         = out;
+  point.bits        = bits;
+  point.window_size = window_size;
+  point.window      = g_memdup2 (window, window_size);
+
+  g_array_append_val (index->points, point);
+  index->dirty = TRUE;
+}
+
+// Last checkpoint at or before out, NULL if there is none
+const GstGzdecCheckpoint *
+gst_gzdec_index_lookup (GstGzdecIndex * index, guint64 out)
+{
+  guint lo = 0, hi = index->points->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (index->points, GstGzdecCheckpoint, mid).out <= out)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return NULL;
+
+  return &g_array_index (index->points, GstGzdecCheckpoint, lo - 1);
+}
+
+void
+gst_gzdec_index_add_boundary (GstGzdecIndex * index, guint64 bit)
+{
+  GArray * boundaries = index->boundaries;
+
+  if (boundaries->len > 0
+      && bit <= g_array_index (boundaries, guint64, boundaries->len - 1))
+    return;
+
+  g_array_append_val (boundaries, bit);
+  index->dirty = TRUE;
+}
+
+// Forget a boundary that turned out not to be one
+void
+gst_gzdec_index_remove_boundary (GstGzdecIndex * index, guint64 bit)
+{
+  guint i;
+
+  // Usually one of the last ones
+  for (i = index->boundaries->len; i > 0; i--) {
+    if (g_array_index (index->boundaries, guint64, i - 1) == bit) {
+      g_array_remove_index (index->boundaries, i - 1);
+      index->dirty = TRUE;
+      return;
+    }
+  }
+}
+
+// First known boundary at or after from_bit
+gboolean
+gst_gzdec_index_next_boundary (GstGzdecIndex * index, guint64 from_bit,
+    guint64 * bit)
+{
+  GArray * boundaries = index->boundaries;
+  guint lo = 0, hi = boundaries->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (boundaries, guint64, mid) < from_bit)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == boundaries->len)
+    return FALSE;
+
+  *bit = g_array_index (boundaries, guint64, lo);
+  return TRUE;
+}
+
+static void
+put_uint32 (GByteArray * array, guint32 value)
+{
+  guint8 bytes[4];
+
+  GST_WRITE_UINT32_LE (bytes, value);
+  g_byte_array_append (array, bytes, 4);
+}
+
+static void
+put_uint64 (GByteArray * array, guint64 value)
+{
+  guint8 bytes[8];
+
+  GST_WRITE_UINT64_LE (bytes, value);
+  g_byte_array_append (array, bytes, 8);
+}
+
+gboolean
+gst_gzdec_index_save (GstGzdecIndex * index, const gchar * location,
+    GError ** error)
+{
+  GByteArray * file = g_byte_array_new ();
+  gboolean ret;
+  guint i;
+
+  g_byte_array_append (file, (const guint8 *) INDEX_MAGIC, 4);
+  put_uint32 (file, INDEX_VERSION);
+  put_uint32 (file, index->format);
+  put_uint32 (file, index->points->len);
+  put_uint32 (file, index->boundaries->len);
+  put_uint64 (file, index->in_size);
+  put_uint64 (file, index->total_out);
+  put_uint32 (file, index->fingerprint);
+
+  for (i = 0; i < index->points->len; i++) {
+    GstGzdecCheckpoint * point =
+        &g_array_index (index->points, GstGzdecCheckpoint, i);
+    uLongf packed_size = compressBound (point->window_size);
+    guint pos;
+
+    put_uint64 (file, point->in);
+    put_uint64 (file, point->out);
+    put_uint32 (file, point->bits);
+    put_uint32 (file, point->window_size);
+
+    pos = file->len;
+    g_byte_array_set_size (file, pos + 4 + packed_size);
+    if (compress2 (file->data + pos + 4, &packed_size, point->window,
+            point->window_size, Z_BEST_COMPRESSION) != Z_OK) {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+          "could not compress checkpoint window");
+      g_byte_array_unref (file);
+      return FALSE;
+    }
+    GST_WRITE_UINT32_LE (file->data + pos, packed_size);
+    g_byte_array_set_size (file, pos + 4 + packed_size);
+  }
+
+  for (i = 0; i < index->boundaries->len; i++)
+    put_uint64 (file, g_array_index (index->boundaries, guint64, i));
+
+  put_uint32 (file, crc32 (0, file->data, file->len));
+
+  ret = g_file_set_contents (location, (const gchar *) file->data,
+      file->len, error);
+  if (ret)
+    index->dirty = FALSE;
+
+  g_byte_array_unref (file);
+  return ret;
+}
+
+GstGzdecIndex *
+gst_gzdec_index_load (const gchar * location, GError ** error)
+{
+  GstGzdecIndex * index = NULL;
+  gchar * contents;
+  const guint8 * data, * end;
+  gsize size;
+  guint n_points, n_boundaries, i;
+
+  if (! g_file_get_contents (location, &contents, &size, error))
+    return NULL;
+
+  data = (const guint8 *) contents;
+  if (size < INDEX_HEADER_SIZE + 4 || memcmp (data, INDEX_MAGIC, 4) != 0
+      || GST_READ_UINT32_LE (data + 4) != INDEX_VERSION)
+    goto invalid;
+
+  end = data + size - 4;
+  if (crc32 (0, data, end - data) != GST_READ_UINT32_LE (end))
+    goto invalid;
+
+  index = gst_gzdec_index_new ();
+  index->format      = GST_READ_UINT32_LE (data + 8);
+  n_points           = GST_READ_UINT32_LE (data + 12);
+  n_boundaries       = GST_READ_UINT32_LE (data + 16);
+  index->in_size     = GST_READ_UINT64_LE (data + 20);
+  index->total_out   = GST_READ_UINT64_LE (data + 28);
+  index->fingerprint = GST_READ_UINT32_LE (data + 36);
+  data += INDEX_HEADER_SIZE;
+
+  for (i = 0; i < n_points; i++) {
+    GstGzdecCheckpoint point;
+    uLongf window_size;
+    guint packed_size;
+
+    if (end - data < INDEX_POINT_SIZE)
+      goto invalid;
+
+    point.in          = GST_READ_UINT64_LE (data);
+    point.out         = GST_READ_UINT64_LE (data + 8);
+    point.bits        = GST_READ_UINT32_LE (data + 16);
+    point.window_size = GST_READ_UINT32_LE (data + 20);
+    packed_size       = GST_READ_UINT32_LE (data + 24);
+    data += INDEX_POINT_SIZE;
+
+    if (point.bits > 7 || point.window_size > GZDEC_WINDOW_SIZE
+        || (gsize) (end - data) < packed_size
+        || (i > 0 && point.out <= gst_gzdec_index_last_out (index)))
+      goto invalid;
+
+    point.window = g_malloc (MAX (point.window_size, 1));
+    window_size  = point.window_size;
+    if (uncompress (point.window, &window_size, data, packed_size) != Z_OK
+        || window_size != point.window_size) {
+      g_free (point.window);
+      goto invalid;
+    }
+    data += packed_size;
+
+    g_array_append_val (index->points, point);
+  }
+
+  if ((gsize) (end - data) != (gsize) n_boundaries * 8)
+    goto invalid;
+
+  for (i = 0; i < n_boundaries; i++, data += 8)
+    gst_gzdec_index_add_boundary (index, GST_READ_UINT64_LE (data));
+
+  index->dirty = FALSE;
+  g_free (contents);
+  return index;
+
+ invalid:
+  {
+    gst_gzdec_index_free (index);
+    g_free (contents);
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s is not a valid gzdec index", location);
+    return NULL;
+  }
+}
@@ -0,0 +1,115 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_GZDEC_INDEX_H__
+#define __GST_GZDEC_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Size of the deflate window saved with every checkpoint
+#define GZDEC_WINDOW_SIZE 32768
+
+// Bytes at either end of the archive its index fingerprint covers
+#define GZDEC_FINGERPRINT_SIZE 65536
+
+/* A position inside a deflate stream where inflating can be resumed:
+ * the compressed and decoded offsets, the number of bits of the byte
+ * before in that still belong to the next block, and the last up to
+ * 32 KiB of output the next blocks may refer back to.
+ */
+typedef struct
+{
+  guint64   in;
+  guint64   out;
+  guint     bits;
+  guint     window_size;
+  guint8  * window;
+} GstGzdecCheckpoint;
+
+typedef struct _GstGzdecIndex GstGzdecIndex;
+
+struct _GstGzdecIndex
+{
+  // GstGzdecCheckpoint, ascending by out
+  GArray  * points;
+  // Input bit offsets where bzip2 blocks end, ascending, so the
+  // parallel decoder does not have to search for the next block magic
+  GArray  * boundaries;
+
+  // GstGzdecFormat of the indexed stream
+  guint     format;
+  // Compressed and decoded stream size, 0 if not known
+  guint64   in_size;
+  guint64   total_out;
+  // CRC-32 of the head and tail of the archive, see GZDEC_FINGERPRINT_SIZE
+  guint32   fingerprint;
+
+  // Changed since it was loaded or created
+  gboolean  dirty;
+};
+
+GstGzdecIndex * gst_gzdec_index_new (void);
+void gst_gzdec_index_free (GstGzdecIndex * index);
+guint64 gst_gzdec_index_last_out (GstGzdecIndex * index);
+void gst_gzdec_index_add (GstGzdecIndex * index, guint64 in, guint64 out,
+    guint bits, const guint8 * window, guint window_size);
+const GstGzdecCheckpoint * gst_gzdec_index_lookup (GstGzdecIndex * index,
+    guint64 out);
+void gst_gzdec_index_add_boundary (GstGzdecIndex * index, guint64 bit);
+void gst_gzdec_index_remove_boundary (GstGzdecIndex * index, guint64 bit);
+gboolean gst_gzdec_index_next_boundary (GstGzdecIndex * index,
+    guint64 from_bit, guint64 * bit);
+
+GstGzdecIndex * gst_gzdec_index_load (const gchar * location,
+    GError ** error);
+gboolean gst_gzdec_index_save (GstGzdecIndex * index,
+    const gchar * location, GError ** error);
+
+G_END_DECLS
+
+#endif /* __GST_GZDEC_INDEX_H__ */
@@ -0,0 +1,239 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Buffer meta mapping decoded output back to the compressed stream.
+ *
+ * gzip members, bzip2 streams and zstd or LZ4 frames can all be decoded
+ * on their own, so the compressed offset of the member a buffer starts
+ * in, and how far into the member it starts, is all a reader needs to
+ * decode that range again without going through the file from the top.
+ * The record meta saves consumers of line oriented output a pass of
+ * their own over it, see gstgzdecrecords.c.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstgzdecmeta.h"
+
+GType
+gst_gzdec_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar * tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType api = gst_meta_api_type_register ("GstGzdecMetaAPI", tags);
+    g_once_init_leave (&type, api);
+  }
+
+  return type;
+}
+
+static gboolean
+gst_gzdec_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstGzdecMeta * gzmeta = (GstGzdecMeta *) meta;
+
+  gzmeta->member        = GST_GZDEC_META_MEMBER_UNKNOWN;
+  gzmeta->member_offset = 0;
+  gzmeta->offset        = 0;
+
+  return TRUE;
+}
+
+// A region copy starts that much further into the member
+static gboolean
+gst_gzdec_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstGzdecMeta * gzmeta = (GstGzdecMeta *) meta;
+  guint64 offset = gzmeta->offset;
+
+  if (! GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  if (((GstMetaTransformCopy *) data)->region)
+    offset += ((GstMetaTransformCopy *) data)->offset;
+
+  return gst_buffer_add_gzdec_meta (dest, gzmeta->member,
+      gzmeta->member_offset, offset) != NULL;
+}
+
+const GstMetaInfo *
+gst_gzdec_meta_get_info (void)
+{
+  static gsize info = 0;
+
+  if (g_once_init_enter (&info)) {
+    const GstMetaInfo * meta = gst_meta_register (GST_GZDEC_META_API_TYPE,
+        "GstGzdecMeta", sizeof (GstGzdecMeta), gst_gzdec_meta_init,
+        NULL, gst_gzdec_meta_transform);
+    g_once_init_leave (&info, (gsize) meta);
+  }
+
+  return (const GstMetaInfo *) info;
+}
+
+GstGzdecMeta *
+gst_buffer_add_gzdec_meta (GstBuffer * buffer, guint member,
+    guint64 member_offset, guint64 offset)
+{
+  GstGzdecMeta * gzmeta;
+
+  gzmeta = (GstGzdecMeta *) gst_buffer_add_meta (buffer,
+      GST_GZDEC_META_INFO, NULL);
+  if (gzmeta == NULL)
+    return NULL;
+
+  gzmeta->member        = member;
+  gzmeta->member_offset = member_offset;
+  gzmeta->offset        = offset;
+
+  return gzmeta;
+}
+
+GType
+gst_gzdec_record_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar * tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType api = gst_meta_api_type_register ("GstGzdecRecordMetaAPI", tags);
+    g_once_init_leave (&type, api);
+  }
+
+  return type;
+}
+
+static gboolean
+gst_gzdec_record_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstGzdecRecordMeta * rmeta = (GstGzdecRecordMeta *) meta;
+
+  rmeta->n_records = 0;
+  rmeta->ends      = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_gzdec_record_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  g_free (((GstGzdecRecordMeta *) meta)->ends);
+}
+
+// A region copy keeps the records ending in the region
+static gboolean
+gst_gzdec_record_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstGzdecRecordMeta * rmeta = (GstGzdecRecordMeta *) meta;
+  GstGzdecRecordMeta * copy;
+  gsize start = 0, size = G_MAXSIZE;
+  guint i;
+
+  if (! GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  if (((GstMetaTransformCopy *) data)->region) {
+    start = ((GstMetaTransformCopy *) data)->offset;
+    size  = ((GstMetaTransformCopy *) data)->size;
+  }
+
+  copy = gst_buffer_add_gzdec_record_meta (dest, NULL, 0);
+  if (copy == NULL)
+    return FALSE;
+
+  copy->ends = g_new (gsize, MAX (rmeta->n_records, 1));
+  for (i = 0; i < rmeta->n_records; i++) {
+    gsize end = rmeta->ends[i];
+
+    if (end > start && end - start <= size)
+      copy->ends[copy->n_records++] = end - start;
+  }
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_gzdec_record_meta_get_info (void)
+{
+  static gsize info = 0;
+
+  if (g_once_init_enter (&info)) {
+    const GstMetaInfo * meta = gst_meta_register (
+        GST_GZDEC_RECORD_META_API_TYPE, "GstGzdecRecordMeta",
+        sizeof (GstGzdecRecordMeta), gst_gzdec_record_meta_init,
+        gst_gzdec_record_meta_free, gst_gzdec_record_meta_transform);
+    g_once_init_leave (&info, (gsize) meta);
+  }
+
+  return (const GstMetaInfo *) info;
+}
+
+GstGzdecRecordMeta *
+gst_buffer_add_gzdec_record_meta (GstBuffer * buffer, const gsize * ends,
+    guint n_records)
+{
+  GstGzdecRecordMeta * rmeta;
+
+  rmeta = (GstGzdecRecordMeta *) gst_buffer_add_meta (buffer,
+      GST_GZDEC_RECORD_META_INFO, NULL);
+  if (rmeta == NULL)
+    return NULL;
+
+  rmeta->n_records = n_records;
+  if (n_records > 0)
+    rmeta->ends = g_memdup2 (ends, n_records * sizeof (gsize));
+
+  return rmeta;
+}
@@ -0,0 +1,113 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_GZDEC_META_H__
+#define __GST_GZDEC_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_GZDEC_META_API_TYPE (gst_gzdec_meta_api_get_type ())
+#define GST_GZDEC_META_INFO (gst_gzdec_meta_get_info ())
+// member of a GstGzdecMeta when decoding resumed from a seek index
+#define GST_GZDEC_META_MEMBER_UNKNOWN G_MAXUINT
+
+#define GST_GZDEC_RECORD_META_API_TYPE (gst_gzdec_record_meta_api_get_type ())
+#define GST_GZDEC_RECORD_META_INFO (gst_gzdec_record_meta_get_info ())
+
+typedef struct _GstGzdecMeta GstGzdecMeta;
+typedef struct _GstGzdecRecordMeta GstGzdecRecordMeta;
+
+/* Where the first byte of a decoded buffer comes from, with the
+ * member-meta property. Decoding from member_offset and dropping offset
+ * bytes gets the buffer again. Applications without this header find
+ * the API as "GstGzdecMetaAPI" and the fields in this order.
+ */
+struct _GstGzdecMeta
+{
+  GstMeta  meta;
+
+  // Index of the gzip member, bzip2 stream or zstd/LZ4 frame
+  guint    member;
+  // Compressed offset of the start of that member
+  guint64  member_offset;
+  // Decoded bytes of the member before the buffer
+  guint64  offset;
+};
+
+/* Newline terminated records in a decoded buffer, with the record-meta
+ * property: the offset just past the newline of each record that ends in
+ * the buffer, in increasing order. Found as "GstGzdecRecordMetaAPI".
+ */
+struct _GstGzdecRecordMeta
+{
+  GstMeta  meta;
+
+  guint    n_records;
+  gsize  * ends;
+};
+
+GType gst_gzdec_meta_api_get_type (void);
+const GstMetaInfo * gst_gzdec_meta_get_info (void);
+
+#define gst_buffer_get_gzdec_meta(b) \
+    ((GstGzdecMeta *) gst_buffer_get_meta ((b), GST_GZDEC_META_API_TYPE))
+GstGzdecMeta * gst_buffer_add_gzdec_meta (GstBuffer * buffer, guint member,
+    guint64 member_offset, guint64 offset);
+
+GType gst_gzdec_record_meta_api_get_type (void);
+const GstMetaInfo * gst_gzdec_record_meta_get_info (void);
+
+#define gst_buffer_get_gzdec_record_meta(b) \
+    ((GstGzdecRecordMeta *) gst_buffer_get_meta ((b), \
+        GST_GZDEC_RECORD_META_API_TYPE))
+GstGzdecRecordMeta * gst_buffer_add_gzdec_record_meta (GstBuffer * buffer,
+    const gsize * ends, guint n_records);
+
+G_END_DECLS
+
+#endif /* __GST_GZDEC_META_H__ */
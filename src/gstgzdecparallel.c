@@ -0,0 +1,1012 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Parallel decoding of independent pieces of a compressed stream.
+ *
+ * The element cuts the input into jobs whose boundaries are known
+ * without decoding, BGZF blocks which carry their own compressed size,
+ * zstd and LZ4 frames which record their decoded size, and bzip2 blocks
+ * which start with a 48 bit magic, and hands them to a GThreadPool.
+ * Jobs are kept in submission order and handed back only from the head
+ * of the queue, so output stays in stream order; at most max_pending
+ * jobs exist at a time, which bounds the memory waiting for reordering.
+ *
+ * Workers allocate the output of a job themselves and are the first to
+ * write it, so its pages come from the NUMA node they run on. With
+ * worker-affinity they stay there: the pool gets threads of its own,
+ * each pinned to one CPU or to the CPUs of one node as it takes its
+ * first job, and the per thread decoder state and arena blocks are
+ * reused on that CPU or node from then on. Consecutive workers go to
+ * different nodes, so a few threads already use the memory bandwidth
+ * of every node.
+ */
+
+// pthread_setaffinity_np () and the CPU_SET () macros
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+#include <zlib.h>
+#include <bzlib.h>
+#ifdef HAVE_LIBDEFLATE
+#  include <libdeflate.h>
+#endif
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#  include <zstd_errors.h>
+#endif
+#ifdef HAVE_LZ4
+#  include <lz4frame.h>
+#endif
+
+#include "gstgzdec.h"
+#include "gstgzdecparallel.h"
+#include "gstgzdecarena.h"
+#include "gstgzdeccrc.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gst_gzdec_debug);
+#define GST_CAT_DEFAULT gst_gzdec_debug
+
+// Jobs in flight per worker thread
+#define JOBS_PER_THREAD 4
+
+static void gst_gzdec_parallel_run (gpointer data, gpointer user_data);
+static void free_inflate_stream (gpointer data);
+
+// Every worker thread keeps its inflate state between jobs
+static GPrivate inflate_stream = G_PRIVATE_INIT (free_inflate_stream);
+#ifdef HAVE_LIBDEFLATE
+static GPrivate deflate_decompressor =
+    G_PRIVATE_INIT ((GDestroyNotify) libdeflate_free_decompressor);
+#endif
+#ifdef HAVE_ZSTD
+static GPrivate zstd_dctx = G_PRIVATE_INIT ((GDestroyNotify) ZSTD_freeDCtx);
+#endif
+#ifdef HAVE_LZ4
+static GPrivate lz4_dctx =
+    G_PRIVATE_INIT ((GDestroyNotify) LZ4F_freeDecompressionContext);
+#endif
+// Set while a worker thread is pinned. Pinning pools have threads of
+// their own, but GLib may hand those to other pools once they are freed
+static GPrivate worker_pinned;
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+// CPUs the process may run on when the first pool is placed, what a
+// worker of an unpinned pool gets back
+static cpu_set_t process_cpus;
+static gsize process_cpus_read;
+
+// CPUs set in a sysfs cpulist such as "0-3,8-11" and in allowed
+static GArray *
+read_cpulist (const gchar * path, const cpu_set_t * allowed)
+{
+  GArray * cpus;
+  gchar * contents;
+  gchar ** ranges;
+  guint i;
+
+  if (! g_file_get_contents (path, &contents, NULL, NULL))
+    return NULL;
+
+  cpus = g_array_new (FALSE, FALSE, sizeof (guint));
+  ranges = g_strsplit (g_strstrip (contents), ",", -1);
+  for (i = 0; ranges[i] != NULL; i++) {
+    gchar * end;
+    guint64 first, last, cpu;
+
+    first = g_ascii_strtoull (ranges[i], &end, 10);
+    if (end == ranges[i])
+      continue;
+    last = *end == '-' ? g_ascii_strtoull (end + 1, NULL, 10) : first;
+
+    for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      guint n = cpu;
+
+      if (CPU_ISSET (n, allowed))
+        g_array_append_val (cpus, n);
+    }
+  }
+  g_strfreev (ranges);
+  g_free (contents);
+
+  return cpus;
+}
+
+/* The CPUs of every NUMA node, as GArrays of CPU numbers. All CPUs are
+ * one node if sysfs has no nodes.
+ */
+static GPtrArray *
+read_nodes (const cpu_set_t * allowed)
+{
+  GPtrArray * nodes;
+  GDir * dir;
+  const gchar * name;
+
+  nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+
+  dir = g_dir_open ("/sys/devices/system/node", 0, NULL);
+  while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+    gchar * path;
+    GArray * cpus;
+
+    if (! g_str_has_prefix (name, "node")
+        || ! g_ascii_isdigit (name[strlen ("node")]))
+      continue;
+
+    path = g_build_filename ("/sys/devices/system/node", name, "cpulist",
+        NULL);
+    cpus = read_cpulist (path, allowed);
+    g_free (path);
+
+    if (cpus != NULL && cpus->len > 0)
+      g_ptr_array_add (nodes, cpus);
+    else if (cpus != NULL)
+      g_array_unref (cpus);
+  }
+  if (dir != NULL)
+    g_dir_close (dir);
+
+  if (nodes->len == 0) {
+    GArray * cpus = g_array_new (FALSE, FALSE, sizeof (guint));
+    guint cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET (cpu, allowed))
+        g_array_append_val (cpus, cpu);
+    g_ptr_array_add (nodes, cpus);
+  }
+
+  return nodes;
+}
+
+// CPU sets to pin the workers of par to, NULL if there are none
+static GArray *
+gst_gzdec_parallel_place (GstGzdecParallel * par)
+{
+  GPtrArray * nodes;
+  GArray * placements;
+  guint i, n_cpus = 0, round;
+
+  if (g_once_init_enter (&process_cpus_read)) {
+    if (sched_getaffinity (0, sizeof (process_cpus), &process_cpus) != 0) {
+      GST_WARNING ("could not get the CPU affinity: %s", g_strerror (errno));
+      CPU_ZERO (&process_cpus);
+    }
+    g_once_init_leave (&process_cpus_read, 1);
+  }
+  if (CPU_COUNT (&process_cpus) == 0)
+    return NULL;
+
+  nodes = read_nodes (&process_cpus);
+  placements = g_array_new (FALSE, TRUE, sizeof (cpu_set_t));
+
+  if (par->affinity == GST_GZDEC_WORKER_AFFINITY_NODE) {
+    for (i = 0; i < nodes->len; i++) {
+      GArray * cpus = g_ptr_array_index (nodes, i);
+      cpu_set_t set;
+      guint j;
+
+      CPU_ZERO (&set);
+      for (j = 0; j < cpus->len; j++)
+        CPU_SET (g_array_index (cpus, guint, j), &set);
+      g_array_append_val (placements, set);
+    }
+  } else {
+    for (i = 0; i < nodes->len; i++)
+      n_cpus += ((GArray *) g_ptr_array_index (nodes, i))->len;
+
+    // The first CPU of every node, then the second, ...
+    for (round = 0; placements->len < n_cpus; round++) {
+      for (i = 0; i < nodes->len; i++) {
+        GArray * cpus = g_ptr_array_index (nodes, i);
+        cpu_set_t set;
+
+        if (round >= cpus->len)
+          continue;
+
+        CPU_ZERO (&set);
+        CPU_SET (g_array_index (cpus, guint, round), &set);
+        g_array_append_val (placements, set);
+      }
+    }
+  }
+
+  GST_DEBUG ("placing workers on %u NUMA node(s), %u place(s)", nodes->len,
+      placements->len);
+  g_ptr_array_unref (nodes);
+
+  if (placements->len == 0)
+    g_clear_pointer (&placements, g_array_unref);
+
+  return placements;
+}
+#endif
+
+/* On the first job of a worker thread in par, pin it to the next place
+ * of par, or back to all CPUs if par does not pin and the pool it was
+ * pinned for is gone.
+ */
+static void
+gst_gzdec_parallel_pin (GstGzdecParallel * par)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  const cpu_set_t * set = &process_cpus;
+  guint worker = 0;
+  int error;
+
+  if (par->placements != NULL) {
+    worker = g_atomic_int_add (&par->n_started, 1);
+    set = &g_array_index (par->placements, cpu_set_t,
+        worker % par->placements->len);
+  }
+
+  error = pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), set);
+  if (error != 0) {
+    GST_WARNING ("could not pin worker %u: %s", worker, g_strerror (error));
+  } else if (par->placements != NULL) {
+    GST_DEBUG ("worker %u pinned to %d CPU(s)", worker, CPU_COUNT (set));
+    gst_gzdec_arena_pin_thread ();
+  }
+#endif
+
+  g_private_set (&worker_pinned, GINT_TO_POINTER (par->placements != NULL));
+}
+
+GstGzdecParallel *
+gst_gzdec_parallel_new (guint threads, gint affinity)
+{
+  GstGzdecParallel * par;
+  GError * error = NULL;
+
+  if (threads == 0)
+    threads = g_get_num_processors ();
+
+  par = g_new0 (GstGzdecParallel, 1);
+  g_mutex_init (&par->lock);
+  g_cond_init (&par->cond);
+  g_queue_init (&par->jobs);
+  par->max_pending = threads * JOBS_PER_THREAD;
+  par->affinity    = affinity;
+
+  if (affinity != GST_GZDEC_WORKER_AFFINITY_NONE) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    par->placements = gst_gzdec_parallel_place (par);
+#else
+    GST_WARNING ("worker-affinity is not supported on this platform");
+#endif
+  }
+
+  // Pinned threads must not serve other pools, GLib shares the threads
+  // of non-exclusive pools process wide
+  par->pool = g_thread_pool_new (gst_gzdec_parallel_run, par, threads,
+      par->placements != NULL, &error);
+  if (par->pool == NULL) {
+    GST_WARNING ("could not create worker pool: %s", error->message);
+    g_error_free (error);
+    gst_gzdec_parallel_free (par);
+    return NULL;
+  }
+
+  GST_DEBUG ("decoding on %u worker threads", threads);
+  return par;
+}
+
+/* Wait for the workers to finish whatever they have started and drop all
+ * jobs, decoded or not.
+ */
+void
+gst_gzdec_parallel_free (GstGzdecParallel * par)
+{
+  if (par == NULL)
+    return;
+
+  if (par->pool != NULL)
+    g_thread_pool_free (par->pool, FALSE, TRUE);
+
+  g_queue_clear_full (&par->jobs, (GDestroyNotify) gst_gzdec_job_free);
+  g_clear_pointer (&par->placements, g_array_unref);
+  g_cond_clear (&par->cond);
+  g_mutex_clear (&par->lock);
+  g_free (par);
+}
+
+gboolean
+gst_gzdec_parallel_is_full (GstGzdecParallel * par)
+{
+  gboolean full;
+
+  g_mutex_lock (&par->lock);
+  full = g_queue_get_length (&par->jobs) >= par->max_pending;
+  g_mutex_unlock (&par->lock);
+
+  return full;
+}
+
+void
+gst_gzdec_parallel_submit (GstGzdecParallel * par, GstGzdecJob * job)
+{
+  g_mutex_lock (&par->lock);
+  g_queue_push_tail (&par->jobs, job);
+  g_mutex_unlock (&par->lock);
+
+  g_thread_pool_push (par->pool, job, NULL);
+}
+
+/* Take the oldest job if it is done. With wait set, block until it is.
+ * Returns NULL if there is nothing (yet) to hand out.
+ */
+GstGzdecJob *
+gst_gzdec_parallel_pop (GstGzdecParallel * par, gboolean wait)
+{
+  GstGzdecJob * job;
+
+  g_mutex_lock (&par->lock);
+  job = g_queue_peek_head (&par->jobs);
+  while (wait && job != NULL && ! job->done)
+    g_cond_wait (&par->cond, &par->lock);
+
+  if (job != NULL && job->done)
+    g_queue_pop_head (&par->jobs);
+  else
+    job = NULL;
+  g_mutex_unlock (&par->lock);
+
+  return job;
+}
+
+static void
+gst_gzdec_parallel_run (gpointer data, gpointer user_data)
+{
+  GstGzdecParallel * par = user_data;
+  GstGzdecJob * job = data;
+  gboolean ok;
+
+  if ((par->placements != NULL) != (g_private_get (&worker_pinned) != NULL))
+    gst_gzdec_parallel_pin (par);
+
+  ok = job->func (job);
+
+  g_mutex_lock (&par->lock);
+  job->failed = ! ok;
+  job->done   = TRUE;
+  g_cond_broadcast (&par->cond);
+  g_mutex_unlock (&par->lock);
+}
+
+GstGzdecJob *
+gst_gzdec_job_new (GstGzdecJobFunc func, const guint8 * data, gsize size,
+    GstAllocator * allocator, const GstAllocationParams * params)
+{
+  GstGzdecJob * job = g_new0 (GstGzdecJob, 1);
+
+  job->func    = func;
+  job->in_data = g_memdup2 (data, size);
+  job->in_size = size;
+  job->member_in = -1;
+
+  if (allocator != NULL)
+    job->allocator = gst_object_ref (allocator);
+  if (params != NULL)
+    job->params = *params;
+  else
+    gst_allocation_params_init (&job->params);
+
+  return job;
+}
+
+void
+gst_gzdec_job_free (GstGzdecJob * job)
+{
+  g_free (job->in_data);
+  if (job->output != NULL)
+    gst_memory_unref (job->output);
+  gst_clear_object (&job->allocator);
+  g_free (job);
+}
+
+/* Size of the BGZF block (a gzip member with a "BC" extra subfield
+ * holding its own compressed size) starting at data. Returns 0 if the
+ * member is not a BGZF block and -1 if more data is needed to tell.
+ */
+gssize
+gst_gzdec_bgzf_block_size (const guint8 * data, gsize size)
+{
+  gsize xlen, pos;
+
+  if (size < 12)
+    return -1;
+
+  if (data[0] != 0x1f || data[1] != 0x8b || data[2] != Z_DEFLATED
+      || (data[3] & 0x04) == 0)
+    return 0;
+
+  xlen = GST_READ_UINT16_LE (data + 10);
+  if (size < 12 + xlen)
+    return -1;
+
+  for (pos = 12; pos + 4 <= 12 + xlen; ) {
+    gsize slen = GST_READ_UINT16_LE (data + pos + 2);
+
+    if (data[pos] == 'B' && data[pos + 1] == 'C' && slen == 2
+        && pos + 6 <= 12 + xlen)
+      return GST_READ_UINT16_LE (data + pos + 4) + 1;
+
+    pos += 4 + slen;
+  }
+
+  return 0;
+}
+
+/* BGZF block as a frame, its decoded size is the ISIZE trailer. The
+ * trailer is only trusted as far as deflate can expand the block, and
+ * like zstd and LZ4 frames up to MAX_FRAME_CONTENT_SIZE; anything above
+ * is left to the serial decoder, which allocates as it goes.
+ */
+gssize
+gst_gzdec_bgzf_frame_size (const guint8 * data, gsize size,
+    guint64 * out_size)
+{
+  gssize block_size = gst_gzdec_bgzf_block_size (data, size);
+  guint64 isize;
+
+  if (block_size <= 0)
+    return block_size;
+  if ((gsize) block_size > size)
+    return -1;
+
+  isize = GST_READ_UINT32_LE (data + block_size - 4);
+  if (isize > (guint64) block_size * DEFLATE_MAX_RATIO
+      || isize > MAX_FRAME_CONTENT_SIZE) {
+    GST_DEBUG ("BGZF block of %" G_GSSIZE_FORMAT " bytes claims %"
+        G_GUINT64_FORMAT " decoded bytes", block_size, isize);
+    return 0;
+  }
+
+  *out_size = isize;
+  return block_size;
+}
+
+static void
+free_inflate_stream (gpointer data)
+{
+  z_stream * stream = data;
+
+  inflateEnd (stream);
+  g_free (stream);
+}
+
+/* Inflate one complete gzip member into a memory of exactly out_hint
+ * (ISIZE) bytes. Unless verify is full zlib skips the CRC-32, which is
+ * then computed here or not at all.
+ */
+gboolean
+gst_gzdec_job_inflate (GstGzdecJob * job)
+{
+  z_stream * stream = g_private_get (&inflate_stream);
+  GstMapInfo map;
+  int status;
+
+  if (stream == NULL) {
+    stream = g_new0 (z_stream, 1);
+    stream->zalloc = gst_gzdec_zalloc;
+    stream->zfree  = gst_gzdec_zfree;
+    if (inflateInit2 (stream, 15 | 16) != Z_OK) {
+      g_free (stream);
+      return FALSE;
+    }
+    g_private_set (&inflate_stream, stream);
+  } else if (inflateReset (stream) != Z_OK) {
+    return FALSE;
+  }
+  if (inflateValidate (stream, job->verify == GST_GZDEC_VERIFY_FULL)
+      != Z_OK)
+    return FALSE;
+
+  job->output = gst_allocator_alloc (job->allocator, MAX (job->out_hint, 1),
+      &job->params);
+  if (job->output == NULL)
+    return FALSE;
+
+  if (! gst_memory_map (job->output, &map, GST_MAP_WRITE))
+    return FALSE;
+
+  stream->next_in   = job->in_data;
+  stream->avail_in  = job->in_size;
+  stream->next_out  = map.data;
+  stream->avail_out = job->out_hint;
+
+  status = inflate (stream, Z_FINISH);
+  if (status == Z_STREAM_END && job->verify == GST_GZDEC_VERIFY_HARDWARE
+      && gst_gzdec_crc32 (0, map.data, stream->total_out)
+      != GST_READ_UINT32_LE (job->in_data + job->in_size - 8))
+    status = Z_DATA_ERROR;
+  gst_memory_unmap (job->output, &map);
+
+  if (status != Z_STREAM_END || stream->total_out != job->out_hint) {
+    GST_WARNING ("corrupt gzip member: ZLIB_ERROR(%d)", status);
+    return FALSE;
+  }
+
+  gst_memory_resize (job->output, 0, job->out_hint);
+  return TRUE;
+}
+
+#ifdef HAVE_LIBDEFLATE
+// Same as gst_gzdec_job_inflate, with libdeflate
+gboolean
+gst_gzdec_job_libdeflate (GstGzdecJob * job)
+{
+  struct libdeflate_decompressor * decompressor;
+  enum libdeflate_result result;
+  GstMapInfo map;
+
+  decompressor = g_private_get (&deflate_decompressor);
+  if (decompressor == NULL) {
+    decompressor = libdeflate_alloc_decompressor ();
+    if (decompressor == NULL)
+      return FALSE;
+    g_private_set (&deflate_decompressor, decompressor);
+  }
+
+  job->output = gst_allocator_alloc (job->allocator, MAX (job->out_hint, 1),
+      &job->params);
+  if (job->output == NULL)
+    return FALSE;
+
+  if (! gst_memory_map (job->output, &map, GST_MAP_WRITE))
+    return FALSE;
+
+  result = libdeflate_gzip_decompress (decompressor, job->in_data,
+      job->in_size, map.data, job->out_hint, NULL);
+  gst_memory_unmap (job->output, &map);
+
+  if (result != LIBDEFLATE_SUCCESS) {
+    GST_WARNING ("corrupt gzip member: LIBDEFLATE_ERROR(%d)", result);
+    return FALSE;
+  }
+
+  gst_memory_resize (job->output, 0, job->out_hint);
+  return TRUE;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+gssize
+gst_gzdec_zstd_frame_size (const guint8 * data, gsize size,
+    guint64 * out_size)
+{
+  unsigned long long content_size;
+  size_t frame_size;
+
+  content_size = ZSTD_getFrameContentSize (data, size);
+  // Frame headers take at most 18 bytes
+  if (content_size == ZSTD_CONTENTSIZE_ERROR)
+    return size < 18 ? -1 : 0;
+  if (content_size == ZSTD_CONTENTSIZE_UNKNOWN
+      || content_size > MAX_FRAME_CONTENT_SIZE)
+    return 0;
+
+  frame_size = ZSTD_findFrameCompressedSize (data, size);
+  if (ZSTD_isError (frame_size))
+    return ZSTD_getErrorCode (frame_size) == ZSTD_error_srcSize_wrong
+        ? -1 : 0;
+
+  *out_size = content_size;
+  return frame_size;
+}
+
+// Decode one complete zstd frame into a memory of exactly out_hint bytes
+gboolean
+gst_gzdec_job_zstd (GstGzdecJob * job)
+{
+  ZSTD_DCtx * dctx;
+  GstMapInfo map;
+  size_t result;
+
+  dctx = g_private_get (&zstd_dctx);
+  if (dctx == NULL) {
+    dctx = ZSTD_createDCtx ();
+    if (dctx == NULL)
+      return FALSE;
+    g_private_set (&zstd_dctx, dctx);
+  }
+
+  job->output = gst_allocator_alloc (job->allocator, MAX (job->out_hint, 1),
+      &job->params);
+  if (job->output == NULL)
+    return FALSE;
+
+  if (! gst_memory_map (job->output, &map, GST_MAP_WRITE))
+    return FALSE;
+
+  result = ZSTD_decompressDCtx (dctx, map.data, job->out_hint,
+      job->in_data, job->in_size);
+  gst_memory_unmap (job->output, &map);
+
+  if (ZSTD_isError (result) || result != job->out_hint) {
+    GST_WARNING ("corrupt zstd frame: %s", ZSTD_isError (result)
+        ? ZSTD_getErrorName (result) : "wrong content size");
+    return FALSE;
+  }
+
+  gst_memory_resize (job->output, 0, job->out_hint);
+  return TRUE;
+}
+#endif
+
+#ifdef HAVE_LZ4
+/* LZ4 frames do not store their compressed size, so walk the block
+ * headers to the end mark. Only frames that store their content size
+ * can be jobs.
+ */
+gssize
+gst_gzdec_lz4_frame_size (const guint8 * data, gsize size,
+    guint64 * out_size)
+{
+  guint64 content_size;
+  guint8 flags;
+  gsize pos;
+
+  if (size < 7)
+    return -1;
+
+  flags = data[4];
+  if (GST_READ_UINT32_LE (data) != LZ4F_MAGICNUMBER || flags >> 6 != 1
+      || (flags & 0x08) == 0)
+    return 0;
+
+  // FLG, BD, content size, optional dictionary ID, header checksum
+  pos = 4 + 2 + 8 + (flags & 0x01 ? 4 : 0) + 1;
+  if (size < pos)
+    return -1;
+
+  content_size = GST_READ_UINT64_LE (data + 6);
+  if (content_size > MAX_FRAME_CONTENT_SIZE)
+    return 0;
+
+  while (TRUE) {
+    guint32 block;
+
+    if (size - pos < 4)
+      return -1;
+    block = GST_READ_UINT32_LE (data + pos);
+    pos += 4;
+
+    // End mark
+    if (block == 0)
+      break;
+
+    // The top bit flags an uncompressed block
+    pos += (block & 0x7fffffff) + (flags & 0x10 ? 4 : 0);
+    if (pos > size)
+      return -1;
+  }
+
+  pos += flags & 0x04 ? 4 : 0;
+  if (pos > size)
+    return -1;
+
+  *out_size = content_size;
+  return pos;
+}
+
+// Same as gst_gzdec_job_zstd, for one complete LZ4 frame
+gboolean
+gst_gzdec_job_lz4 (GstGzdecJob * job)
+{
+  LZ4F_dctx * dctx;
+  GstMapInfo map;
+  size_t out_size = job->out_hint;
+  size_t in_size = job->in_size;
+  size_t result;
+
+  dctx = g_private_get (&lz4_dctx);
+  if (dctx == NULL) {
+    if (LZ4F_isError (LZ4F_createDecompressionContext (&dctx,
+                LZ4F_VERSION)))
+      return FALSE;
+    g_private_set (&lz4_dctx, dctx);
+  }
+  LZ4F_resetDecompressionContext (dctx);
+
+  job->output = gst_allocator_alloc (job->allocator, MAX (job->out_hint, 1),
+      &job->params);
+  if (job->output == NULL)
+    return FALSE;
+
+  if (! gst_memory_map (job->output, &map, GST_MAP_WRITE))
+    return FALSE;
+
+  result = LZ4F_decompress (dctx, map.data, &out_size, job->in_data,
+      &in_size, NULL);
+  gst_memory_unmap (job->output, &map);
+
+  if (result != 0 || out_size != job->out_hint || in_size != job->in_size) {
+    GST_WARNING ("corrupt LZ4 frame: %s", LZ4F_isError (result)
+        ? LZ4F_getErrorName (result) : "wrong content size");
+    return FALSE;
+  }
+
+  gst_memory_resize (job->output, 0, job->out_hint);
+  return TRUE;
+}
+#endif
+
+/* Read n <= 57 bits, most significant first, starting at bit of data.
+ * The caller makes sure the bytes holding them exist.
+ */
+guint64
+gst_gzdec_read_bits (const guint8 * data, guint64 bit, guint n)
+{
+  guint64 value = 0;
+  guint shift = bit % 8;
+  guint bytes = (shift + n + 7) / 8;
+  guint i;
+
+  data += bit / 8;
+  for (i = 0; i < bytes; i++)
+    value = value << 8 | data[i];
+
+  return (value >> (bytes * 8 - shift - n)) & ((G_GUINT64_CONSTANT (1) << n) - 1);
+}
+
+/* Find the first bzip2 block or end of stream magic starting at or after
+ * from_bit. Returns its bit offset, or -1 with next_bit set to where a
+ * later search over more data has to resume.
+ */
+gint64
+gst_gzdec_bzip2_find_magic (const guint8 * data, gsize size,
+    guint64 from_bit, guint64 * next_bit)
+{
+  const guint64 mask = (G_GUINT64_CONSTANT (1) << 48) - 1;
+  guint64 end_bit = (guint64) size * 8;
+  gsize i;
+
+  if (end_bit < 48 || from_bit > end_bit - 48) {
+    *next_bit = from_bit;
+    return -1;
+  }
+
+  // Slide a 64 bit window one byte at a time and try all 8 alignments
+  for (i = from_bit / 8; (guint64) i * 8 + 48 <= end_bit; i++) {
+    guint64 window = 0;
+    guint k;
+
+    for (k = 0; k < 8; k++)
+      window = window << 8 | (i + k < size ? data[i + k] : 0);
+
+    for (k = 0; k < 8; k++) {
+      guint64 bit = (guint64) i * 8 + k;
+      guint64 value = (window >> (16 - k)) & mask;
+
+      if (bit < from_bit || bit + 48 > end_bit)
+        continue;
+      if (value == BZIP2_BLOCK_MAGIC || value == BZIP2_EOS_MAGIC)
+        return bit;
+    }
+  }
+
+  *next_bit = end_bit - 47;
+  return -1;
+}
+
+static void
+put_bits (guint8 * data, guint64 * bit, guint64 value, guint n)
+{
+  while (n-- > 0) {
+    if (value >> n & 1)
+      data[*bit / 8] |= 0x80 >> (*bit % 8);
+    (*bit)++;
+  }
+}
+
+/* Turn the block of n_bits starting at start_bit (at its block magic) into
+ * a complete single block stream: a "BZh" header of the original level,
+ * the block shifted to the front, and an end of stream marker. The stream
+ * CRC of a one block stream is the block CRC.
+ */
+GstGzdecJob *
+gst_gzdec_job_new_bzip2_block (const guint8 * data, guint64 start_bit,
+    guint64 n_bits, gint level)
+{
+  GstGzdecJob * job = g_new0 (GstGzdecJob, 1);
+  const guint8 * src = data + start_bit / 8;
+  guint shift = start_bit % 8;
+  guint64 full = n_bits / 8;
+  guint64 bit, i;
+  guint8 * out;
+
+  job->func     = gst_gzdec_job_bunzip2;
+  job->member_in = -1;
+  job->level    = level;
+  job->n_bits   = n_bits;
+  job->crc      = gst_gzdec_read_bits (data, start_bit + 48, 32);
+  job->in_size  = 4 + full + 1 + 10 + 1;
+  job->in_data  = out = g_malloc0 (job->in_size);
+  job->out_hint = level * 100000;
+  gst_allocation_params_init (&job->params);
+
+  out[0] = 'B';
+  out[1] = 'Z';
+  out[2] = 'h';
+  out[3] = '0' + level;
+  out += 4;
+
+  if (shift == 0) {
+    memcpy (out, src, full);
+  } else {
+    for (i = 0; i < full; i++)
+      out[i] = src[i] << shift | src[i + 1] >> (8 - shift);
+  }
+
+  bit = full * 8;
+  put_bits (out, &bit, gst_gzdec_read_bits (data, start_bit + full * 8,
+          n_bits % 8), n_bits % 8);
+  put_bits (out, &bit, BZIP2_EOS_MAGIC, 48);
+  put_bits (out, &bit, job->crc, 32);
+
+  job->in_size = 4 + (bit + 7) / 8;
+  return job;
+}
+
+// Append the first n bits of src at bit of data
+static void
+put_block_bits (guint8 * data, guint64 * bit, const guint8 * src, guint64 n)
+{
+  guint64 i;
+
+  for (i = 0; i < n / 8; i++)
+    put_bits (data, bit, src[i], 8);
+  put_bits (data, bit, gst_gzdec_read_bits (src, n / 8 * 8, n % 8), n % 8);
+}
+
+/* One block job for the blocks of two consecutive ones, in case the
+ * magic between them was a false match inside a single block. The block
+ * bits of a job follow its 4 byte stream header.
+ */
+GstGzdecJob *
+gst_gzdec_job_join_bzip2_blocks (GstGzdecJob * first, GstGzdecJob * second)
+{
+  guint8 * data = g_malloc0 ((first->n_bits + second->n_bits + 7) / 8 + 8);
+  GstGzdecJob * job;
+  guint64 bit = 0;
+
+  put_block_bits (data, &bit, first->in_data + 4, first->n_bits);
+  put_block_bits (data, &bit, second->in_data + 4, second->n_bits);
+
+  job = gst_gzdec_job_new_bzip2_block (data, 0, bit, first->level);
+  job->start_bit = first->start_bit;
+  job->member    = first->member;
+  job->member_in = first->member_in;
+  g_free (data);
+
+  return job;
+}
+
+static gboolean
+gst_gzdec_job_bzip2_end (GstGzdecJob * job)
+{
+  return TRUE;
+}
+
+/* Marks the end of a bzip2 stream among its block jobs, so its CRC is
+ * checked once the CRCs of all of them are known.
+ */
+GstGzdecJob *
+gst_gzdec_job_new_bzip2_end (guint32 crc)
+{
+  GstGzdecJob * job = g_new0 (GstGzdecJob, 1);
+
+  job->func       = gst_gzdec_job_bzip2_end;
+  job->member_in  = -1;
+  job->crc        = crc;
+  job->stream_end = TRUE;
+
+  return job;
+}
+
+/* Decompress a single block stream made by gst_gzdec_job_new_bzip2_block.
+ * The decoded size is not known up front, so the output grows from the
+ * block size and is wrapped into a memory at the end.
+ */
+gboolean
+gst_gzdec_job_bunzip2 (GstGzdecJob * job)
+{
+  bz_stream stream;
+  gsize size = MAX (job->out_hint, 4096), produced = 0;
+  guint8 * data;
+  int status;
+
+  // Every block is a stream of its own, reuse the buffers of the last one
+  memset (&stream, 0, sizeof (stream));
+  stream.bzalloc = gst_gzdec_bzalloc;
+  stream.bzfree  = gst_gzdec_bzfree;
+  if (BZ2_bzDecompressInit (&stream, 0, 0) != BZ_OK)
+    return FALSE;
+
+  data = g_malloc (size);
+  stream.next_in  = (char *) job->in_data;
+  stream.avail_in = job->in_size;
+
+  do {
+    guint avail;
+
+    if (produced == size) {
+      size *= 2;
+      data = g_realloc (data, size);
+    }
+
+    avail = MIN (size - produced, G_MAXUINT);
+    stream.next_out  = (char *) data + produced;
+    stream.avail_out = avail;
+
+    status = BZ2_bzDecompress (&stream);
+    produced += avail - stream.avail_out;
+  } while (status == BZ_OK && (stream.avail_out == 0 || stream.avail_in > 0));
+
+  BZ2_bzDecompressEnd (&stream);
+
+  if (status != BZ_STREAM_END) {
+    GST_WARNING ("corrupt bzip2 block: BZLIB_ERROR(%d)", status);
+    g_free (data);
+    return FALSE;
+  }
+
+  job->output = gst_memory_new_wrapped (0, data, size, 0, produced, data,
+      g_free);
+  return TRUE;
+}
@@ -0,0 +1,178 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_GZDEC_PARALLEL_H__
+#define __GST_GZDEC_PARALLEL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Smallest header that tells whether a gzip member is a BGZF block
+#define BGZF_HEADER_SIZE 18
+// Largest zstd or LZ4 frame decoded as one job, bigger ones are streamed
+#define MAX_FRAME_CONTENT_SIZE (64 * 1024 * 1024)
+// Bound on what deflate can expand to, 258 bytes per match of 2 bits
+// give about 1032:1
+#define DEFLATE_MAX_RATIO 1032
+
+typedef struct _GstGzdecJob GstGzdecJob;
+typedef struct _GstGzdecParallel GstGzdecParallel;
+
+typedef gboolean (* GstGzdecJobFunc) (GstGzdecJob *);
+/* Compressed size of the frame at data, with its decoded size in
+ * out_size. 0 if it cannot be decoded as a job, -1 if more data is
+ * needed to tell.
+ */
+typedef gssize (* GstGzdecFrameSizeFunc) (const guint8 * data, gsize size,
+    guint64 * out_size);
+
+/* One independently decodable piece of input (a gzip member, a zstd or
+ * LZ4 frame, a bzip2 block) and, once a worker is done with it, its decoded output.
+ */
+struct _GstGzdecJob
+{
+  GstGzdecJobFunc       func;
+
+  // Compressed input, owned by the job
+  guint8              * in_data;
+  gsize                 in_size;
+  // Decoded size if known up front (gzip ISIZE, frame content size),
+  // 0 otherwise
+  gsize                 out_hint;
+  // GstGzdecVerify of the element, for gzip members
+  gint                  verify;
+  // Index and compressed offset of the member the job starts, for
+  // GstGzdecMeta; member_in is -1 if it starts none
+  guint                 member;
+  gint64                member_in;
+  // bzip2 blocks: level of the stream, input bit offset and length of
+  // the block and its CRC. stream_end jobs decode nothing and carry the
+  // stream CRC instead
+  gint                  level;
+  guint64               start_bit;
+  guint64               n_bits;
+  guint32               crc;
+  gboolean              stream_end;
+
+  GstAllocator        * allocator;
+  GstAllocationParams   params;
+
+  // Set by the worker
+  GstMemory           * output;
+  gboolean              done;
+  gboolean              failed;
+};
+
+/* Worker pool plus the jobs in submission order, so output can be
+ * emitted in stream order no matter which worker finishes first.
+ */
+struct _GstGzdecParallel
+{
+  GThreadPool * pool;
+  GMutex        lock;
+  GCond         cond;
+  GQueue        jobs;
+  // Bound on queued and finished but not yet emitted jobs
+  guint         max_pending;
+  // GstGzdecWorkerAffinity of the element, and the CPU sets (cpu_set_t)
+  // workers are pinned to in the order they start, NULL if not pinning
+  gint          affinity;
+  GArray      * placements;
+  gint          n_started;
+};
+
+GstGzdecParallel * gst_gzdec_parallel_new (guint threads, gint affinity);
+void gst_gzdec_parallel_free (GstGzdecParallel * par);
+gboolean gst_gzdec_parallel_is_full (GstGzdecParallel * par);
+void gst_gzdec_parallel_submit (GstGzdecParallel * par, GstGzdecJob * job);
+GstGzdecJob * gst_gzdec_parallel_pop (GstGzdecParallel * par,
+    gboolean wait);
+
+GstGzdecJob * gst_gzdec_job_new (GstGzdecJobFunc func,
+    const guint8 * data, gsize size, GstAllocator * allocator,
+    const GstAllocationParams * params);
+void gst_gzdec_job_free (GstGzdecJob * job);
+
+gssize gst_gzdec_bgzf_block_size (const guint8 * data, gsize size);
+gssize gst_gzdec_bgzf_frame_size (const guint8 * data, gsize size,
+    guint64 * out_size);
+gboolean gst_gzdec_job_inflate (GstGzdecJob * job);
+#ifdef HAVE_LIBDEFLATE
+gboolean gst_gzdec_job_libdeflate (GstGzdecJob * job);
+#endif
+
+#ifdef HAVE_ZSTD
+gssize gst_gzdec_zstd_frame_size (const guint8 * data, gsize size,
+    guint64 * out_size);
+gboolean gst_gzdec_job_zstd (GstGzdecJob * job);
+#endif
+#ifdef HAVE_LZ4
+gssize gst_gzdec_lz4_frame_size (const guint8 * data, gsize size,
+    guint64 * out_size);
+gboolean gst_gzdec_job_lz4 (GstGzdecJob * job);
+#endif
+
+// bzip2 block header and end of stream magic, 48 bits each
+#define BZIP2_BLOCK_MAGIC G_GUINT64_CONSTANT (0x314159265359)
+#define BZIP2_EOS_MAGIC   G_GUINT64_CONSTANT (0x177245385090)
+// Bound on the compressed bits of a block of the given level, 1.25 bits
+// per byte of the block size
+#define BZIP2_MAX_BLOCK_BITS(level) ((guint64) (level) * 1000000 + 8192)
+
+guint64 gst_gzdec_read_bits (const guint8 * data, guint64 bit, guint n);
+gint64 gst_gzdec_bzip2_find_magic (const guint8 * data, gsize size,
+    guint64 from_bit, guint64 * next_bit);
+GstGzdecJob * gst_gzdec_job_new_bzip2_block (const guint8 * data,
+    guint64 start_bit, guint64 n_bits, gint level);
+GstGzdecJob * gst_gzdec_job_join_bzip2_blocks (GstGzdecJob * first,
+    GstGzdecJob * second);
+GstGzdecJob * gst_gzdec_job_new_bzip2_end (guint32 crc);
+gboolean gst_gzdec_job_bunzip2 (GstGzdecJob * job);
+
+G_END_DECLS
+
+#endif /* __GST_GZDEC_PARALLEL_H__ */
@@ -0,0 +1,235 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Newline scanning for record framing.
+ *
+ * Decoded logs are scanned once here, right before they are pushed,
+ * instead of by every consumer downstream. Calling memchr () per line
+ * costs a call and its setup for every 100 bytes or so of a typical
+ * log; the vector kernels compare 32 (AVX2) or 16 (NEON) bytes at once
+ * and walk the resulting bit mask, so the cost no longer depends on the
+ * line length. The tail shorter than a vector, and CPUs without either,
+ * go through memchr ().
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+
+#include "gstgzdecrecords.h"
+
+#if defined (__GNUC__) && defined (__x86_64__)
+#  define GZDEC_RECORDS_AVX2
+#  include <immintrin.h>
+#elif defined (__aarch64__)
+#  define GZDEC_RECORDS_NEON
+#  include <arm_neon.h>
+#endif
+
+#define RECORD_DELIMITER '\n'
+// Ends collected before they go into the array at once, two vectors' worth
+#define RECORD_BATCH 64
+
+typedef enum
+{
+  RECORDS_IMPL_MEMCHR = 1,
+  RECORDS_IMPL_AVX2,
+  RECORDS_IMPL_NEON
+} RecordsImpl;
+
+// Picked on first use, 0 until then
+static gsize records_impl;
+
+static RecordsImpl
+records_get_impl (void)
+{
+  if (g_once_init_enter (&records_impl)) {
+    gsize impl = RECORDS_IMPL_MEMCHR;
+#if defined (GZDEC_RECORDS_AVX2)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+      impl = RECORDS_IMPL_AVX2;
+#elif defined (GZDEC_RECORDS_NEON)
+    impl = RECORDS_IMPL_NEON;
+#endif
+    g_once_init_leave (&records_impl, impl);
+  }
+
+  return records_impl;
+}
+
+// base is the offset of data in the buffer
+static void
+records_memchr (const guint8 * data, gsize size, gsize base, GArray * ends)
+{
+  const guint8 * p = data;
+  const guint8 * end = data + size;
+
+  while (p < end
+      && (p = memchr (p, RECORD_DELIMITER, end - p)) != NULL) {
+    gsize offset = base + (p - data) + 1;
+
+    g_array_append_val (ends, offset);
+    p++;
+  }
+}
+
+#ifdef GZDEC_RECORDS_AVX2
+__attribute__ ((target ("avx2")))
+static void
+records_avx2 (const guint8 * data, gsize size, gsize base, GArray * ends)
+{
+  const __m256i delimiter = _mm256_set1_epi8 (RECORD_DELIMITER);
+  gsize found[RECORD_BATCH];
+  guint n_found = 0;
+  gsize pos;
+
+  for (pos = 0; pos + 32 <= size; pos += 32) {
+    __m256i block = _mm256_loadu_si256 ((const __m256i *) (data + pos));
+    guint32 mask = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (block,
+            delimiter));
+
+    while (mask != 0) {
+      found[n_found++] = base + pos + __builtin_ctz (mask) + 1;
+      mask &= mask - 1;
+    }
+    if (n_found > RECORD_BATCH - 32) {
+      g_array_append_vals (ends, found, n_found);
+      n_found = 0;
+    }
+  }
+  g_array_append_vals (ends, found, n_found);
+
+  records_memchr (data + pos, size - pos, base + pos, ends);
+}
+#endif
+
+#ifdef GZDEC_RECORDS_NEON
+static void
+records_neon (const guint8 * data, gsize size, gsize base, GArray * ends)
+{
+  const uint8x16_t delimiter = vdupq_n_u8 (RECORD_DELIMITER);
+  gsize found[RECORD_BATCH];
+  guint n_found = 0;
+  gsize pos;
+
+  for (pos = 0; pos + 16 <= size; pos += 16) {
+    uint8x16_t equal = vceqq_u8 (vld1q_u8 (data + pos), delimiter);
+    // No movemask on NEON: narrowing leaves four bits per byte, keep one
+    guint64 mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (
+                vreinterpretq_u16_u8 (equal), 4)), 0)
+        & G_GUINT64_CONSTANT (0x8888888888888888);
+
+    while (mask != 0) {
+      found[n_found++] = base + pos + __builtin_ctzll (mask) / 4 + 1;
+      mask &= mask - 1;
+    }
+    if (n_found > RECORD_BATCH - 16) {
+      g_array_append_vals (ends, found, n_found);
+      n_found = 0;
+    }
+  }
+  g_array_append_vals (ends, found, n_found);
+
+  records_memchr (data + pos, size - pos, base + pos, ends);
+}
+#endif
+
+static void
+records_find (const guint8 * data, gsize size, gsize base, GArray * ends)
+{
+  switch (records_get_impl ()) {
+#if defined (GZDEC_RECORDS_AVX2)
+    case RECORDS_IMPL_AVX2:
+      records_avx2 (data, size, base, ends);
+      return;
+#elif defined (GZDEC_RECORDS_NEON)
+    case RECORDS_IMPL_NEON:
+      records_neon (data, size, base, ends);
+      return;
+#endif
+    default:
+      records_memchr (data, size, base, ends);
+      return;
+  }
+}
+
+void
+gst_gzdec_find_records (GstBuffer * buf, gsize from, GArray * ends)
+{
+  guint i, n_memory = gst_buffer_n_memory (buf);
+  gsize base = 0;
+
+  for (i = 0; i < n_memory; i++) {
+    GstMemory * mem = gst_buffer_peek_memory (buf, i);
+    gsize size = gst_memory_get_sizes (mem, NULL, NULL);
+    GstMapInfo map;
+
+    if (base + size > from && gst_memory_map (mem, &map, GST_MAP_READ)) {
+      gsize skip = from > base ? from - base : 0;
+
+      records_find (map.data + skip, map.size - skip, base + skip, ends);
+      gst_memory_unmap (mem, &map);
+    }
+    base += size;
+  }
+}
+
+const gchar *
+gst_gzdec_find_records_impl (void)
+{
+  switch (records_get_impl ()) {
+    case RECORDS_IMPL_AVX2:
+      return "AVX2";
+    case RECORDS_IMPL_NEON:
+      return "NEON";
+    default:
+      return "memchr";
+  }
+}
@@ -0,0 +1,261 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Hand-off between the upstream streaming thread and the src pad task in
+ * async mode.
+ *
+ * A fixed array of slots with one writer and one reader: the producer
+ * only moves head, the consumer only moves tail, so neither takes a lock
+ * while there is room and data. The mutex and condition are only used to
+ * sleep on a full or empty ring. A sleeper counts itself in waiting
+ * before checking the ring again, and the other side takes the lock to
+ * wake it only when waiting is set, so no wakeup gets lost in between.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstgzdecring.h"
+
+typedef gboolean (* GstGzdecRingCheck) (GstGzdecRing *, gint);
+
+static gint
+gst_gzdec_ring_next (GstGzdecRing * ring, gint slot)
+{
+  return (slot + 1) % ring->capacity;
+}
+
+static gint
+gst_gzdec_ring_item_size (GstMiniObject * item)
+{
+  if (! GST_IS_BUFFER (item))
+    return 0;
+  return MIN (gst_buffer_get_size (GST_BUFFER_CAST (item)), G_MAXINT / 2);
+}
+
+static gboolean
+gst_gzdec_ring_is_full (GstGzdecRing * ring, gint size)
+{
+  gint level;
+
+  if (gst_gzdec_ring_next (ring, ring->head)
+      == g_atomic_int_get (&ring->tail))
+    return TRUE;
+
+  // A buffer over the bound still goes into an empty ring
+  level = g_atomic_int_get (&ring->level);
+  return level > 0 && level + size > g_atomic_int_get (&ring->max_level);
+}
+
+static gboolean
+gst_gzdec_ring_is_empty (GstGzdecRing * ring, gint size)
+{
+  return g_atomic_int_get (&ring->head) == ring->tail;
+}
+
+/* Sleep until woken, or until the monotonic end_time unless it is -1.
+ * FALSE once end_time has passed.
+ */
+static gboolean
+gst_gzdec_ring_wait (GstGzdecRing * ring, GstGzdecRingCheck blocked,
+    gint size, gint64 end_time)
+{
+  gboolean woken = TRUE;
+
+  g_mutex_lock (&ring->lock);
+  g_atomic_int_inc (&ring->waiting);
+  if (blocked (ring, size) && g_atomic_int_get (&ring->flow) == GST_FLOW_OK) {
+    if (end_time < 0)
+      g_cond_wait (&ring->cond, &ring->lock);
+    else
+      woken = g_cond_wait_until (&ring->cond, &ring->lock, end_time);
+  }
+  g_atomic_int_add (&ring->waiting, -1);
+  g_mutex_unlock (&ring->lock);
+
+  return woken;
+}
+
+static void
+gst_gzdec_ring_wake (GstGzdecRing * ring)
+{
+  if (g_atomic_int_get (&ring->waiting) == 0)
+    return;
+
+  g_mutex_lock (&ring->lock);
+  g_cond_broadcast (&ring->cond);
+  g_mutex_unlock (&ring->lock);
+}
+
+GstGzdecRing *
+gst_gzdec_ring_new (guint capacity, guint max_level)
+{
+  GstGzdecRing * ring = g_new0 (GstGzdecRing, 1);
+
+  // Plus the slot that always stays free
+  ring->capacity  = capacity + 1;
+  ring->slots     = g_new0 (GstMiniObject *, ring->capacity);
+  ring->max_level = MIN (max_level, G_MAXINT / 2);
+  ring->flow      = GST_FLOW_OK;
+  g_mutex_init (&ring->lock);
+  g_cond_init (&ring->cond);
+
+  return ring;
+}
+
+void
+gst_gzdec_ring_free (GstGzdecRing * ring)
+{
+  gst_gzdec_ring_clear (ring);
+  g_mutex_clear (&ring->lock);
+  g_cond_clear (&ring->cond);
+  g_free (ring->slots);
+  g_free (ring);
+}
+
+void
+gst_gzdec_ring_set_max_level (GstGzdecRing * ring, guint max_level)
+{
+  g_atomic_int_set (&ring->max_level, MIN (max_level, G_MAXINT / 2));
+  // A producer may fit now
+  gst_gzdec_ring_wake (ring);
+}
+
+/* Producer side. Blocks while the ring is full, the item is dropped and
+ * the flow of the ring returned once it is no longer GST_FLOW_OK.
+ */
+GstFlowReturn
+gst_gzdec_ring_push (GstGzdecRing * ring, GstMiniObject * item)
+{
+  gint size = gst_gzdec_ring_item_size (item);
+  GstFlowReturn flow;
+
+  while ((flow = g_atomic_int_get (&ring->flow)) == GST_FLOW_OK
+      && gst_gzdec_ring_is_full (ring, size))
+    gst_gzdec_ring_wait (ring, gst_gzdec_ring_is_full, size, -1);
+
+  if (flow != GST_FLOW_OK) {
+    gst_mini_object_unref (item);
+    return flow;
+  }
+
+  ring->slots[ring->head] = item;
+  g_atomic_int_add (&ring->level, size);
+  g_atomic_int_set (&ring->head, gst_gzdec_ring_next (ring, ring->head));
+  gst_gzdec_ring_wake (ring);
+
+  return GST_FLOW_OK;
+}
+
+/* Consumer side. Blocks while the ring is empty, NULL once the flow of
+ * the ring is no longer GST_FLOW_OK.
+ */
+GstMiniObject *
+gst_gzdec_ring_pop (GstGzdecRing * ring)
+{
+  return gst_gzdec_ring_pop_until (ring, -1);
+}
+
+/* Same as gst_gzdec_ring_pop, but also NULL with the flow still
+ * GST_FLOW_OK once the monotonic end_time passes on an empty ring.
+ */
+GstMiniObject *
+gst_gzdec_ring_pop_until (GstGzdecRing * ring, gint64 end_time)
+{
+  GstMiniObject * item;
+
+  while (g_atomic_int_get (&ring->flow) == GST_FLOW_OK
+      && gst_gzdec_ring_is_empty (ring, 0)) {
+    if (! gst_gzdec_ring_wait (ring, gst_gzdec_ring_is_empty, 0, end_time))
+      break;
+  }
+
+  if (g_atomic_int_get (&ring->flow) != GST_FLOW_OK
+      || gst_gzdec_ring_is_empty (ring, 0))
+    return NULL;
+
+  item = ring->slots[ring->tail];
+  ring->slots[ring->tail] = NULL;
+  g_atomic_int_add (&ring->level, - gst_gzdec_ring_item_size (item));
+  g_atomic_int_set (&ring->tail, gst_gzdec_ring_next (ring, ring->tail));
+  gst_gzdec_ring_wake (ring);
+
+  return item;
+}
+
+/* Anything but GST_FLOW_OK, e.g. GST_FLOW_FLUSHING, wakes both sides and
+ * makes them return without touching the ring.
+ */
+void
+gst_gzdec_ring_set_flow (GstGzdecRing * ring, GstFlowReturn flow)
+{
+  g_atomic_int_set (&ring->flow, flow);
+
+  g_mutex_lock (&ring->lock);
+  g_cond_broadcast (&ring->cond);
+  g_mutex_unlock (&ring->lock);
+}
+
+GstFlowReturn
+gst_gzdec_ring_get_flow (GstGzdecRing * ring)
+{
+  return g_atomic_int_get (&ring->flow);
+}
+
+/* Drop everything queued. Only while the consumer is stopped. */
+void
+gst_gzdec_ring_clear (GstGzdecRing * ring)
+{
+  while (ring->tail != g_atomic_int_get (&ring->head)) {
+    gst_mini_object_unref (ring->slots[ring->tail]);
+    ring->slots[ring->tail] = NULL;
+    ring->tail = gst_gzdec_ring_next (ring, ring->tail);
+  }
+  g_atomic_int_set (&ring->level, 0);
+}
@@ -0,0 +1,227 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2020 Niels De Graef <niels.degraef@gmail.com>
+ * Copyright (C) 2023 Eugene Bulavin <eugene.bulavin.se@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:tracer-gzdecstats
+ *
+ * Logs the statistics of every gzdec in the pipeline, see its stats
+ * property, as a gzdecstats tracer record: at most every interval
+ * milliseconds while the element pushes (1000 by default), and once more
+ * when it goes back to READY.
+ *
+ * |[
+ * GST_TRACERS="gzdecstats(interval=500)" GST_DEBUG=GST_TRACER:7 gst-launch-1.0 ...
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstgzdec.h"
+#include "gstgzdectracer.h"
+
+#define DEFAULT_INTERVAL (1000 * GST_MSECOND)
+
+static GstTracerRecord *tr_stats;
+
+G_DEFINE_TYPE (GstGzdecTracer, gst_gzdec_tracer, GST_TYPE_TRACER);
+
+static void
+log_stats (GstGzdecTracer * self, GstElement * element)
+{
+  GstStructure *s;
+  guint64 bytes_in, bytes_out, buffers, chunks, decode_time, push_time;
+  gdouble ratio;
+
+  g_object_get (element, "stats", &s, NULL);
+  gst_structure_get (s,
+      "bytes-in", G_TYPE_UINT64, &bytes_in,
+      "bytes-out", G_TYPE_UINT64, &bytes_out,
+      "ratio", G_TYPE_DOUBLE, &ratio,
+      "buffers", G_TYPE_UINT64, &buffers,
+      "chunks", G_TYPE_UINT64, &chunks,
+      "decode-time", G_TYPE_UINT64, &decode_time,
+      "push-time", G_TYPE_UINT64, &push_time,
+      NULL);
+  gst_structure_free (s);
+
+  gst_tracer_record_log (tr_stats, GST_OBJECT_NAME (element), bytes_in,
+      bytes_out, ratio, buffers, chunks, decode_time, push_time);
+}
+
+static void
+do_push_post (GstGzdecTracer * self, GstClockTime ts, GstPad * pad,
+    GstFlowReturn res)
+{
+  GstObject *parent = GST_OBJECT_PARENT (pad);
+  gpointer last;
+  gboolean due;
+
+  if (parent == NULL || ! GST_IS_GZDEC (parent))
+    return;
+
+  g_mutex_lock (&self->lock);
+  due = ! g_hash_table_lookup_extended (self->last_log, parent, NULL, &last)
+      || ts - GPOINTER_TO_SIZE (last) >= self->interval;
+  if (due)
+    g_hash_table_insert (self->last_log, parent, GSIZE_TO_POINTER (ts));
+  g_mutex_unlock (&self->lock);
+
+  if (due)
+    log_stats (self, GST_ELEMENT (parent));
+}
+
+// The element clears its statistics when it reaches READY
+static void
+do_change_state_pre (GstGzdecTracer * self, GstClockTime ts,
+    GstElement * element, GstStateChange transition)
+{
+  if (transition != GST_STATE_CHANGE_PAUSED_TO_READY
+      || ! GST_IS_GZDEC (element))
+    return;
+
+  log_stats (self, element);
+
+  g_mutex_lock (&self->lock);
+  g_hash_table_remove (self->last_log, element);
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_gzdec_tracer_constructed (GObject * object)
+{
+  GstGzdecTracer *self = GST_GZDEC_TRACER (object);
+  gchar *params, *str;
+  GstStructure *s;
+  guint interval;
+
+  G_OBJECT_CLASS (gst_gzdec_tracer_parent_class)->constructed (object);
+
+  g_object_get (self, "params", &params, NULL);
+  if (params == NULL)
+    return;
+
+  str = g_strdup_printf ("gzdecstats,%s", params);
+  s = gst_structure_from_string (str, NULL);
+  if (s != NULL && gst_structure_get_uint (s, "interval", &interval))
+    self->interval = interval * GST_MSECOND;
+  if (s != NULL)
+    gst_structure_free (s);
+  g_free (str);
+  g_free (params);
+}
+
+static void
+gst_gzdec_tracer_finalize (GObject * object)
+{
+  GstGzdecTracer *self = GST_GZDEC_TRACER (object);
+
+  g_hash_table_unref (self->last_log);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_gzdec_tracer_parent_class)->finalize (object);
+}
+
+static GstStructure *
+value_spec (GType type, const gchar * description)
+{
+  return gst_structure_new ("value",
+      "type", G_TYPE_GTYPE, type,
+      "description", G_TYPE_STRING, description,
+      NULL);
+}
+
+static void
+gst_gzdec_tracer_class_init (GstGzdecTracerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->constructed = gst_gzdec_tracer_constructed;
+  gobject_class->finalize    = gst_gzdec_tracer_finalize;
+
+  tr_stats = gst_tracer_record_new ("gzdecstats.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+              GST_TRACER_VALUE_SCOPE_ELEMENT,
+          NULL),
+      "bytes-in", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_UINT64, "compressed bytes of the stream"),
+      "bytes-out", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_UINT64, "decoded bytes of the stream"),
+      "ratio", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_DOUBLE, "decoded per compressed byte"),
+      "buffers", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_UINT64, "input buffers decoded"),
+      "chunks", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_UINT64, "output chunks allocated"),
+      "decode-time", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_UINT64, "time spent decoding in ns"),
+      "push-time", GST_TYPE_STRUCTURE,
+          value_spec (G_TYPE_UINT64, "time blocked pushing downstream in ns"),
+      NULL);
+  GST_OBJECT_FLAG_SET (tr_stats, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_gzdec_tracer_init (GstGzdecTracer * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+
+  self->interval = DEFAULT_INTERVAL;
+  g_mutex_init (&self->lock);
+  self->last_log = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "element-change-state-pre",
+      G_CALLBACK (do_change_state_pre));
+}